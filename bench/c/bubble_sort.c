@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+int main() {
+    int n = 1000;
+    int arr[1000];
+    int checksum = 0;
+
+    for (int round = 0; round < 20; round = round + 1) {
+        for (int k = 0; k < n; k = k + 1) {
+            arr[k] = n - k + round;
+        }
+
+        for (int i = n - 1; i >= 0; i = i - 1) {
+            for (int j = 0; j < i; j = j + 1) {
+                if (arr[j] > arr[j + 1]) {
+                    int temp = arr[j];
+                    arr[j] = arr[j + 1];
+                    arr[j + 1] = temp;
+                }
+            }
+        }
+        checksum = checksum + arr[0] + arr[n - 1];
+    }
+
+    printf("first %d, last %d, checksum %d\n", arr[0], arr[n - 1], checksum);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+int main() {
+    int n = 500;
+    double a[500];
+    double b[500];
+
+    for (int i = 0; i < n; i = i + 1) {
+        a[i] = 0.5;
+        b[i] = 2.0;
+    }
+
+    double total = 0.0;
+    for (int round = 0; round < 28000; round = round + 1) {
+        double dot = 0.0;
+        for (int i = 0; i < n; i = i + 1) {
+            dot = dot + a[i] * b[i];
+        }
+        total = total + dot;
+    }
+    printf("total %f\n", total);
+    return 0;
+}
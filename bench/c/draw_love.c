@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+int main() {
+    int inside = 0;
+    for (double y = 1.5; y > -1.5; y = y - 0.001) {
+        for (double x = -1.5; x < 1.5; x = x + 0.0005) {
+            double a = x * x + y * y - 1.0;
+            if (a * a * a - x * x * y * y * y <= 0.0) {
+                inside = inside + 1;
+            }
+        }
+    }
+    printf("%d points inside\n", inside);
+    return 0;
+}
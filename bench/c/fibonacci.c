@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+int fibonacci(int n) {
+    if (n <= 1) {
+        return n;
+    } else {
+        return fibonacci(n - 1) + fibonacci(n - 2);
+    }
+}
+
+int main() {
+    int i;
+    for (i = 1; i <= 32; i = i + 1) {
+        printf("%d level fibonacci result is %d\n", i, fibonacci(i));
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include <stdio.h>
+
+int main() {
+    int steps = 20000000;
+    double width = 1.0 / 20000000.0;
+    double sum = 0.0;
+    double x = 0.5 * width;
+    for (int i = 0; i < steps; i = i + 1) {
+        sum = sum + 4.0 / (1.0 + x * x);
+        x = x + width;
+    }
+    printf("pi is about %.10f\n", sum * width);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+void sort(int *array, int n, bool (*cmp)(int, int)) {
+    for (int i = 0; i < n; i = i + 1) {
+        for (int j = 0; j < n - 1 - i; j = j + 1) {
+            if (cmp(array[j], array[j + 1]) == false) {
+                int temp = array[j];
+                array[j] = array[j + 1];
+                array[j + 1] = temp;
+            }
+        }
+    }
+}
+
+static bool less_equal(int a, int b) {
+    if (a <= b) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+int main() {
+    int n = 1000;
+    int arr[1000];
+    int checksum = 0;
+
+    for (int round = 0; round < 20; round = round + 1) {
+        for (int k = 0; k < n; k = k + 1) {
+            arr[k] = n - k + round;
+        }
+        sort(arr, n, less_equal);
+        checksum = checksum + arr[0] + arr[n - 1];
+    }
+
+    printf("first %d, last %d, checksum %d\n", arr[0], arr[n - 1], checksum);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+int main() {
+    int n = 24;
+    int a[576];
+    int b[576];
+    int c[576];
+
+    for (int i = 0; i < n * n; i = i + 1) {
+        a[i] = i - 288;
+        b[i] = 576 - i;
+    }
+
+    int checksum = 0;
+    for (int round = 0; round < 3000; round = round + 1) {
+        for (int i = 0; i < n; i = i + 1) {
+            for (int j = 0; j < n; j = j + 1) {
+                int s = 0;
+                for (int k = 0; k < n; k = k + 1) {
+                    s = s + a[i * n + k] * b[k * n + j];
+                }
+                c[i * n + j] = s;
+            }
+        }
+        checksum = checksum + c[round - round / n * n] / 1000;
+    }
+    printf("c[0] %d, c[575] %d, checksum %d\n", c[0], c[575], checksum);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+int main() {
+    int n = 1000;
+    bool composite[1000];
+    int primes = 0;
+
+    for (int round = 0; round < 5000; round = round + 1) {
+        for (int i = 0; i < n; i = i + 1) {
+            composite[i] = false;
+        }
+        primes = 0;
+        for (int i = 2; i < n; i = i + 1) {
+            if (composite[i] == false) {
+                primes = primes + 1;
+                for (int j = i * i; j < n; j = j + i) {
+                    composite[j] = true;
+                }
+            }
+        }
+    }
+    printf("%d primes below %d\n", primes, n);
+    return 0;
+}
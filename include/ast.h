@@ -14,8 +14,15 @@ typedef std::vector<NExpression*> ExpressionList;
 typedef std::vector<NVariableDeclaration*> VariableList;
 typedef std::vector<NIdentifier*> IdentifierList;
 
+/* source position of the grammar rule currently reduced (see parser.y) */
+extern int node_line;
+extern int node_column;
+
 class Node {
 public:
+	int line;
+	int column;
+	Node() : line(node_line), column(node_column) { }
 	virtual ~Node() { }
 	virtual llvm::Value* codeGen(CodeGenContext& context) { }
 };
@@ -40,6 +47,23 @@ public:
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+/* integer literal with a width suffix: 200u8, 7i16 */
+class NSizedInteger : public NExpression {
+public:
+	unsigned long long value;
+	std::string type;
+	NSizedInteger(unsigned long long value, const std::string& type) : value(value), type(type) { }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* f32 literal: 0.5f32 */
+class NFloat : public NExpression {
+public:
+	float value;
+	NFloat(float value) : value(value) { }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 class NDouble : public NExpression {
 public:
 	double value;
@@ -65,7 +89,9 @@ class NIdentifier : public NExpression {
 public:
 	bool lazy = false;
 	std::string name;
-	NExpression* index;
+	NExpression* index = nullptr;
+	// struct field: p.x, a[i].x
+	std::string field;
 	NIdentifier(const std::string& name) : name(name) { }
 	NIdentifier(const std::string& name, NExpression* index) : name(name), index(index) { }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
@@ -75,6 +101,8 @@ class NMethodCall : public NExpression {
 public:
 	const NIdentifier& id;
 	ExpressionList arguments;
+	// spawn f(args): run on a worker thread, the result is dropped
+	bool spawn = false;
 	NMethodCall(const NIdentifier& id, ExpressionList& arguments) :
 		id(id), arguments(arguments) { }
 	NMethodCall(const NIdentifier& id) : id(id) { }
@@ -90,6 +118,14 @@ public:
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+/* await task: the task's result once it is done */
+class NAwait : public NExpression {
+public:
+	NExpression& task;
+	NAwait(NExpression& task) : task(task) { }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 class NBinaryOperator : public NExpression {
 public:
 	int op;
@@ -131,10 +167,10 @@ public:
 
 class NForStatement : public NStatement {
 public:
-	NStatement* varDecl;
-	NExpression* start;
-	NExpression* end;
-	NExpression* step;
+	NStatement* varDecl = nullptr;
+	NExpression* start = nullptr;
+	NExpression* end = nullptr;
+	NExpression* step = nullptr;
 	NBlock block;
 	NForStatement(NStatement* varDecl, NExpression* end, NExpression* step, NBlock block) :
 		varDecl(varDecl), end(end), step(step), block(block) {}
@@ -165,8 +201,12 @@ class NVariableDeclaration : public NStatement {
 public:
 	NIdentifier& type;
 	NIdentifier& id;
-	NExpression *assignmentExpr;
+	NExpression *assignmentExpr = nullptr;
 	int arraySize;
+	// array of structs laid out as one array per field
+	bool soa = false;
+	// chan[T, N]: slots of the channel's ring, 0 for the default
+	int capacity = 0;
 	ExpressionList arrayValue;
 	IdentifierList funcParams;
 	NIdentifier funcType = NIdentifier("void");
@@ -181,12 +221,23 @@ public:
 	virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+class NStructDeclaration : public NStatement {
+public:
+	const NIdentifier& id;
+	VariableList fields;
+	NStructDeclaration(const NIdentifier& id, VariableList& fields) : id(id), fields(fields) { }
+	virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 class NFunctionDeclaration : public NStatement {
 public:
 	const NIdentifier& type;
 	const NIdentifier& id;
 	VariableList arguments;
 	NBlock& block;
+	bool isAsync = false;
+	// cleared by markReachable when nothing the program runs can call it
+	bool reachable = true;
 	NFunctionDeclaration(const NIdentifier& type, const NIdentifier& id, VariableList& arguments,
 		NBlock& block) : type(type), id(id), arguments(arguments), block(block) { }
 	virtual llvm::Value* codeGen(CodeGenContext& context);
@@ -1,3 +1,4 @@
+#include <set>
 #include <stack>
 #include <typeinfo>
 #include "llvm/IR/Module.h"
@@ -33,6 +34,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/DIBuilder.h"
 
 using namespace llvm;
 
@@ -49,6 +51,12 @@ public:
 	Value* returnValue;
 	std::map<std::string, Value*> locals;
 	std::map<std::string, NVariableDeclaration*> lazys;
+	// async functions: the coroutine, its task and where a suspension goes to be destroyed or to return
+	Value* coroutineId = nullptr;
+	Value* coroutineHandle = nullptr;
+	Value* task = nullptr;
+	BasicBlock* coroutineCleanup = nullptr;
+	BasicBlock* coroutineSuspend = nullptr;
 };
 
 class CodeGenContext {
@@ -57,6 +65,24 @@ class CodeGenContext {
 
 public:
 	Module *module;
+	// --instrument: profiler hooks around functions and loops
+	bool instrument = false;
+	int profileRegions = 0;
+	// -g: line tables and function/variable DWARF, scopes are the open functions
+	bool debugInfo = false;
+	DIBuilder *dbuilder = nullptr;
+	DIFile *debugFile = nullptr;
+	std::vector<DIScope*> debugScopes;
+	std::map<Type*, DIType*> debugTypes;
+	// --keep-frame-pointers: perf and gdb unwind without DWARF CFI
+	bool keepFramePointers = false;
+	// LLVM integers carry no sign: values, variables, arguments and functions
+	// (for their return value) of the u8 to u64 types are kept here. Never
+	// constants, LLVM shares one per value across the module (see unsignedValue)
+	std::set<Value*> unsignedValues;
+	// [N]u8 and [N]i8 arrays used whole and []u8 arguments: i8* like a string,
+	// but without the length header before the characters
+	std::set<Value*> byteArrays;
 	CodeGenContext(std::string sourceFileName) {
 		module = new Module(sourceFileName, TheContext);
 		register_println(module);
@@ -96,6 +122,31 @@ public:
 	}
 
 	void generateCode(NBlock& root);
+	int profileEnter(const std::string& name);
+	void profileExit(int region);
+	void initDebugInfo();
+	DIType* debugType(Type *type);
+	void debugFunction(Function *function, int line);
+	void debugFunctionEnd();
+	void debugLocation(int line, int column);
+	void debugVariable(Value *storage, const std::string& name, int line, unsigned argNo = 0);
+	void setFramePointers();
+	bool isUnsigned(Value *value) { return unsignedValues.find(value) != unsignedValues.end(); }
+	void setUnsigned(Value *value, bool isUnsigned = true) {
+		if (isa<Constant>(value) && !isa<GlobalValue>(value))
+			return;
+		if (isUnsigned)
+			unsignedValues.insert(value);
+		else
+			unsignedValues.erase(value);
+	}
+	bool isByteArray(Value *value) { return byteArrays.find(value) != byteArrays.end(); }
+	void setByteArray(Value *value, bool isByteArray = true) {
+		if (isByteArray)
+			byteArrays.insert(value);
+		else
+			byteArrays.erase(value);
+	}
 	GenericValue runCode();
 	std::map<std::string, Value*>& locals() { return blocks.top()->locals; }
 	CodeGenBlock* currentBlock() { return blocks.top(); }
@@ -0,0 +1,46 @@
+#ifndef COOCOMPILER_DRIVER_H
+#define COOCOMPILER_DRIVER_H
+
+#include <string>
+#include <vector>
+
+/* Output kinds selected with --emit, any combination can be written */
+enum EmitKind {
+	EMIT_OBJ = 1,
+	EMIT_ASM = 2,
+	EMIT_BC = 4,
+	EMIT_LL = 8,
+};
+
+/* Everything a single compilation needs, filled in from the command line */
+struct CompileOptions {
+	std::string inFile;
+	std::string outFile;
+	// EmitKind bits, object code only when nothing is asked for
+	unsigned emit = 0;
+	// `coo build`: link the runtime in and produce an executable in-process
+	bool build = false;
+	// -O level, -1 picks the mode default (0, or 2 for build)
+	int optLevel = -1;
+	bool staticLink = false;
+	bool gcSections = false;
+	// profiler hooks on every function and loop, see src/runtime/profile.c
+	bool instrument = false;
+	// PGO: where instrumented programs write .profraw, or the .profdata to use
+	std::string profileGenerate;
+	std::string profileUse;
+	// -g and --keep-frame-pointers, for perf and gdb
+	bool debugInfo = false;
+	bool keepFramePointers = false;
+	// --jit: run in-process instead of writing files, --perf-map names JIT code for perf
+	bool jit = false;
+	bool perfMap = false;
+	// --backend-threads=N: object code for N parts of the module, generated in parallel
+	unsigned backendThreads = 1;
+};
+
+bool parseOptions(const std::vector<std::string>& args, CompileOptions& options);
+int compile(const CompileOptions& options);
+void usage();
+
+#endif
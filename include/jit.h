@@ -0,0 +1,8 @@
+#ifndef COOCOMPILER_JIT_H
+#define COOCOMPILER_JIT_H
+
+struct CompileOptions;
+
+int RunJIT(CodeGenContext & context, const CompileOptions& options);
+
+#endif
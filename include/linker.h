@@ -0,0 +1,13 @@
+#ifndef COOCOMPILER_LINKER_H
+#define COOCOMPILER_LINKER_H
+
+#include <string>
+#include <vector>
+
+struct CompileOptions;
+
+bool LinkRuntime(CodeGenContext & context);
+bool LinkExecutable(const std::vector<std::string>& objects, const CompileOptions& options);
+bool LinkRelocatable(const std::vector<std::string>& objects, const std::string& output);
+
+#endif
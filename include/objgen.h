@@ -1,6 +1,18 @@
 #ifndef COOCOMPILER_OBJGEN_H
 #define COOCOMPILER_OBJGEN_H
 
-void ObjGen(CodeGenContext & context, const std::string& filename = "output.o");
+#include <string>
+#include <vector>
 
-#endif
\ No newline at end of file
+namespace llvm {
+	class TargetMachine;
+}
+
+void InitializeObjGen();
+llvm::TargetMachine* GetTargetMachine(const std::string& targetTriple);
+llvm::TargetMachine* SetModuleTarget(CodeGenContext & context);
+bool ObjGen(CodeGenContext & context, const std::string& filename = "output.o", bool assembly = false);
+bool ObjGenParallel(CodeGenContext & context, const std::vector<std::string>& filenames);
+bool IRGen(CodeGenContext & context, const std::string& filename, bool bitcode = false);
+
+#endif
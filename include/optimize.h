@@ -0,0 +1,8 @@
+#ifndef COOCOMPILER_OPTIMIZE_H
+#define COOCOMPILER_OPTIMIZE_H
+
+struct CompileOptions;
+
+void Optimize(CodeGenContext & context, const CompileOptions& options);
+
+#endif
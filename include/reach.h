@@ -0,0 +1,9 @@
+#ifndef COOCOMPILER_REACH_H
+#define COOCOMPILER_REACH_H
+
+class NBlock;
+
+/* Mark the functions the program can reach from its top level, codegen skips the rest */
+void markReachable(NBlock& program);
+
+#endif
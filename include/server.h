@@ -0,0 +1,11 @@
+#ifndef COOCOMPILER_SERVER_H
+#define COOCOMPILER_SERVER_H
+
+#include <string>
+#include <vector>
+
+std::string defaultSocketPath();
+int runServer(const std::string& socketPath);
+int runClient(const std::string& socketPath, const std::vector<std::string>& args);
+
+#endif
@@ -0,0 +1,112 @@
+#!/bin/bash
+
+# Runtime benchmark: compile every bench/coo/*.coo with coo and its twin
+# bench/c/*.c with clang at each -O level, run both repeatedly and report
+# median/p99 wall time and the coo-to-C ratio.
+#
+# usage: bash script/bench.sh [-r runs] [-w warmups] [-O "0 1 2 3"] [-f name]
+
+COO_PATH=bench/coo
+C_PATH=bench/c
+OUTPUT_PATH=build/bench
+BUILTIN=./build/obj/builtin.o
+
+runs=10
+warmups=2
+levels="0 1 2 3"
+filter=""
+
+while getopts "r:w:O:f:" opt; do
+    case ${opt} in
+        r) runs=${OPTARG} ;;
+        w) warmups=${OPTARG} ;;
+        O) levels=${OPTARG} ;;
+        f) filter=${OPTARG} ;;
+        *) echo "usage: $0 [-r runs] [-w warmups] [-O \"0 1 2 3\"] [-f name]"; exit 1 ;;
+    esac
+done
+
+# array declarations are stack allocated, give the larger kernels some room
+ulimit -s unlimited 2>/dev/null || ulimit -s 65536 2>/dev/null
+
+mkdir -p ${OUTPUT_PATH}
+
+# run_times <binary>: prints the wall time of each measured run in microseconds
+run_times() {
+    local i start end
+    for ((i = 0; i < warmups; i++)); do
+        "$1" > /dev/null
+    done
+    for ((i = 0; i < runs; i++)); do
+        start=`date +%s%N`
+        "$1" > /dev/null
+        end=`date +%s%N`
+        echo $(( (end - start) / 1000 ))
+    done
+}
+
+# percentile <p> <values...>: nearest-rank percentile of the given values
+percentile() {
+    local p=$1
+    shift
+    local sorted=(`printf '%s\n' "$@" | sort -n`)
+    local rank=$(( (p * ${#sorted[@]} + 99) / 100 ))
+    [ ${rank} -lt 1 ] && rank=1
+    echo ${sorted[$((rank - 1))]}
+}
+
+failed_arr=()
+
+echo ""
+echo "start benchmarking (${runs} runs, ${warmups} warmups)..."
+echo "======================================================================================"
+printf '%-14s %-4s %14s %14s %14s %14s %8s\n' "benchmark" "opt" "coo median(us)" "coo p99(us)" "c median(us)" "c p99(us)" "coo/c"
+
+for f in `find ${COO_PATH}/*.coo -type f | sort`
+do
+    name=$(basename ${f%.*})
+    if [ -n "${filter}" ] && [ "${name}" != "${filter}" ]; then
+        continue
+    fi
+    if [ ! -e ${C_PATH}/${name}.c ]; then
+        failed_arr+=("${name}: missing ${C_PATH}/${name}.c")
+        continue
+    fi
+
+    # coo front-end once, the textual IR is then lowered at every level
+    if ! ./coo --emit=ll ${f} ${OUTPUT_PATH}/${name} > /dev/null; then
+        failed_arr+=("${name}: coo build fail")
+        continue
+    fi
+
+    for level in ${levels}
+    do
+        coo_bin=${OUTPUT_PATH}/${name}.coo.O${level}
+        c_bin=${OUTPUT_PATH}/${name}.c.O${level}
+        if ! clang -O${level} -Wno-override-module -o ${coo_bin} ${OUTPUT_PATH}/${name}.ll ${BUILTIN} -lpthread \
+            || ! clang -O${level} -o ${c_bin} ${C_PATH}/${name}.c; then
+            failed_arr+=("${name} -O${level}: link fail")
+            continue
+        fi
+        if ! cmp -s <(${coo_bin}) <(${c_bin}); then
+            failed_arr+=("${name} -O${level}: output differs from C baseline")
+            continue
+        fi
+
+        coo_times=(`run_times ${coo_bin}`)
+        c_times=(`run_times ${c_bin}`)
+        coo_median=`percentile 50 ${coo_times[@]}`
+        c_median=`percentile 50 ${c_times[@]}`
+        printf '%-14s %-4s %14s %14s %14s %14s %8s\n' ${name} "-O${level}" \
+            ${coo_median} `percentile 99 ${coo_times[@]}` \
+            ${c_median} `percentile 99 ${c_times[@]}` \
+            `awk -v a=${coo_median} -v b=${c_median} 'BEGIN { if (b > 0) printf "%.2f", a / b; else print "-" }'`
+    done
+done
+
+echo "======================================================================================"
+if [ ${#failed_arr[@]} -ne 0 ]; then
+    echo "Failed benchmarks:"
+    printf '%s\n' "${failed_arr[@]}"
+    exit 1
+fi
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Profile-guided build of one coo program:
+#   1. build an instrumented executable with --profile-generate
+#   2. run it on a training workload, every run leaves a .profraw
+#   3. merge the raw profiles offline with llvm-profdata
+#   4. rebuild with --profile-use
+#
+# usage: bash script/pgo.sh <source.coo> <executable> [training args...]
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <source.coo> <executable> [training args...]"
+    exit 1
+fi
+
+source=$1
+target=$2
+shift 2
+profile_dir=build/pgo/$(basename ${source%.*})
+
+rm -rf ${profile_dir}
+mkdir -p ${profile_dir}
+
+echo "[PGO]building instrumented ${target}..."
+./coo build --profile-generate=${profile_dir} -o ${target} ${source} > /dev/null || exit 1
+
+echo "[PGO]training ${target} $@"
+./${target} "$@" > /dev/null || exit 1
+
+echo "[PGO]merging ${profile_dir}/*.profraw"
+llvm-profdata merge -o ${profile_dir}/merged.profdata ${profile_dir}/*.profraw || exit 1
+
+echo "[PGO]building optimized ${target}..."
+./coo build --profile-use=${profile_dir}/merged.profdata -o ${target} ${source} > /dev/null || exit 1
+echo "[PGO]done"
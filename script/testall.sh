@@ -16,12 +16,45 @@ do
     sum=`expr $sum + 1`
     echo "compile ${f}..."
     name=$(basename ${f%.*})
-    ./coo ${f} ${OUTPUT_PATH}/${name}
+    # <name>.flags holds extra compiler options
+    flags=""
+    if [ -f ${EXPECT_PATH}/${name}.flags ]; then
+        flags=`cat ${EXPECT_PATH}/${name}.flags`
+    fi
+    ./coo ${flags} ${f} ${OUTPUT_PATH}/${name}
     if [ $? -eq 0 ]; then
         echo "BUILD FINE"
-        clang -o ${OUTPUT_PATH}/${name} ${OUTPUT_PATH}/${name}.o ./build/obj/builtin.o
-        ./${OUTPUT_PATH}/${name} > ./${OUTPUT_PATH}/${name}.result
-        if cmp ./${OUTPUT_PATH}/${name}.result ./${EXPECT_PATH}/${name}.expect; then # cmp return `true` if same
+        clang -o ${OUTPUT_PATH}/${name} ${OUTPUT_PATH}/${name}.o ./build/obj/builtin.o -lpthread
+        rm -f ${OUTPUT_PATH}/${name}.txt ${OUTPUT_PATH}/${name}.folded
+        COO_PROFILE=${OUTPUT_PATH}/${name} ./${OUTPUT_PATH}/${name} > ./${OUTPUT_PATH}/${name}.result
+        # <name>.absent lists functions that must not be generated at all
+        absent=""
+        if [ -f ${EXPECT_PATH}/${name}.absent ]; then
+            for symbol in `cat ${EXPECT_PATH}/${name}.absent`
+            do
+                if nm --defined-only ${OUTPUT_PATH}/${name}.o | grep -qw "${symbol}$"; then
+                    absent="${absent} ${symbol}"
+                fi
+            done
+        fi
+        # <name>.regions lists what an --instrument build must name in its profile and folded stacks
+        missing=""
+        if [ -f ${EXPECT_PATH}/${name}.regions ]; then
+            for region in `cat ${EXPECT_PATH}/${name}.regions`
+            do
+                if ! grep -q "  ${region}$" ${OUTPUT_PATH}/${name}.txt 2>/dev/null \
+                    || ! grep -qE "(^|;)${region}[; ]" ${OUTPUT_PATH}/${name}.folded 2>/dev/null; then
+                    missing="${missing} ${region}"
+                fi
+            done
+        fi
+        if [ -n "${absent}" ]; then
+            failed_arr+=(${f})
+            echo "Fail: generated${absent}"
+        elif [ -n "${missing}" ]; then
+            failed_arr+=(${f})
+            echo "Fail: profile misses${missing}"
+        elif cmp ./${OUTPUT_PATH}/${name}.result ./${EXPECT_PATH}/${name}.expect; then # cmp return `true` if same
             success=`expr $success + 1`
         else
             failed_arr+=(${f})
@@ -1,141 +1,2099 @@
+#include <algorithm>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 #include "ast.h"
 #include "codegen.h"
 #include "parser.hpp"
+#include "reach.h"
 #include "ts.h"
 #include "common.h"
 
 using namespace std;
 
+/* Declared structs by name, with their field names in declaration order */
+static std::map<std::string, StructType*> structTypes;
+static std::map<std::string, std::vector<std::string>> structFields;
+// "Struct.field" of the unsigned fields
+static std::set<std::string> unsignedFields;
+
+/* Key and value types of a map[K]V, which is a pointer to an opaque runtime table */
+struct MapType {
+	Type* key;
+	Type* value;
+	bool keyUnsigned;
+	bool valueUnsigned;
+};
+static std::map<std::string, Type*> mapTypeNames;
+static std::map<Type*, MapType> mapTypes;
+
+/* Result type of a task[T], what an async function returns: a pointer to an opaque runtime task */
+struct TaskType {
+	Type* result;
+	bool resultUnsigned;
+};
+static std::map<std::string, Type*> taskTypeNames;
+static std::map<Type*, TaskType> taskTypes;
+
+/* Element type of a chan[T], a pointer to an opaque runtime ring shared between threads */
+struct ChannelType {
+	Type* element;
+	bool elementUnsigned;
+};
+static std::map<std::string, Type*> channelTypeNames;
+static std::map<Type*, ChannelType> channelTypes;
+
 /* Compile AST into a module*/
 void CodeGenContext::generateCode(NBlock& root) {
 	cout << "Generating code...\n";
+	markReachable(root);
+
+	/* Create top level interpreter function to call as entry*/
+	vector<Type*> argTypes;
+	FunctionType *ftype = FunctionType::get(Type::getInt32Ty(TheContext), makeArrayRef(argTypes), false);
+	mainFunction = Function::Create(ftype, GlobalValue::ExternalLinkage, "main", module);
+	BasicBlock *bblock = BasicBlock::Create(TheContext, "entry", mainFunction, 0);
+	BasicBlock *retblock = BasicBlock::Create(TheContext, "retBlock", mainFunction, 0);
+	if (debugInfo)
+		initDebugInfo();
+
+	/* Push a new variable/block context */
+	Builder.SetInsertPoint(bblock);
+	pushBlock(bblock);
+	debugFunction(mainFunction, 1);
+	currentBlock()->returnBlock = retblock;
+	currentBlock()->returnValue = Builder.CreateAlloca(Type::getInt32Ty(TheContext), 0, NULL, "");
+	int region = instrument ? profileEnter("main") : -1;
+	root.codeGen(*this); /* Emit bytecode for toplevel block*/
+
+	// ret part
+	Builder.CreateBr(retblock);
+	Builder.SetInsertPoint(retblock);
+	if (instrument)
+		profileExit(region);
+	Builder.CreateRet(ConstantInt::get(Type::getInt32Ty(TheContext), 0, true));
+	popBlock();
+	debugFunctionEnd();
+	if (dbuilder)
+		dbuilder->finalize();
+	setFramePointers();
+
+	cout << "Code is generated.\n";
+	/*Print the bytecode*/
+	// legacy::PassManager pm;
+	// pm.add(createPrintModulePass(outs()));
+	// pm.run(*module);
+}
+
+/* Call the profiler runtime on entering a region, returns the region id */
+int CodeGenContext::profileEnter(const std::string& name) {
+	int region = profileRegions++;
+	std::vector<Type*> argTypes = { Type::getInt32Ty(TheContext), Type::getInt8PtrTy(TheContext) };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), makeArrayRef(argTypes), false);
+	Constant *enterFunc = module->getOrInsertFunction("__coo_prof_enter", ftype);
+
+	std::vector<Value*> args = { ConstantInt::get(Type::getInt32Ty(TheContext), region, true),
+		Builder.CreateGlobalStringPtr(StringRef(name.c_str())) };
+	Builder.CreateCall(enterFunc, makeArrayRef(args));
+	return region;
+}
+
+void CodeGenContext::profileExit(int region) {
+	std::vector<Type*> argTypes = { Type::getInt32Ty(TheContext) };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), makeArrayRef(argTypes), false);
+	Constant *exitFunc = module->getOrInsertFunction("__coo_prof_exit", ftype);
+
+	std::vector<Value*> args = { ConstantInt::get(Type::getInt32Ty(TheContext), region, true) };
+	Builder.CreateCall(exitFunc, makeArrayRef(args));
+}
+
+/* Compile unit for the source file, everything else hangs off it */
+void CodeGenContext::initDebugInfo() {
+	SmallString<128> path(module->getSourceFileName());
+	sys::fs::make_absolute(path);
+	dbuilder = new DIBuilder(*module);
+	debugFile = dbuilder->createFile(sys::path::filename(path), sys::path::parent_path(path));
+	dbuilder->createCompileUnit(dwarf::DW_LANG_C, debugFile, "coo", false, "", 0);
+	module->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+	module->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+}
+
+/* DWARF type of a LLVM type, named the way coo spells it */
+DIType* CodeGenContext::debugType(Type *type) {
+	auto found = debugTypes.find(type);
+	if (found != debugTypes.end()) {
+		return found->second;
+	}
+
+	const DataLayout& layout = module->getDataLayout();
+	DIType *result;
+	if (type->isIntegerTy(1)) {
+		result = dbuilder->createBasicType("bool", 8, dwarf::DW_ATE_boolean);
+	} else if (type->isIntegerTy(8)) {
+		result = dbuilder->createBasicType("char", 8, dwarf::DW_ATE_signed_char);
+	} else if (type->isIntegerTy(32)) {
+		result = dbuilder->createBasicType("int", 32, dwarf::DW_ATE_signed);
+	} else if (type->isIntegerTy(64)) {
+		result = dbuilder->createBasicType("long", 64, dwarf::DW_ATE_signed);
+	} else if (type->isIntegerTy()) {
+		unsigned bits = type->getIntegerBitWidth();
+		result = dbuilder->createBasicType("i" + to_string(bits), bits, dwarf::DW_ATE_signed);
+	} else if (type->isDoubleTy()) {
+		result = dbuilder->createBasicType("float", 64, dwarf::DW_ATE_float);
+	} else if (type->isFloatingPointTy()) {
+		unsigned bits = type->getPrimitiveSizeInBits();
+		result = dbuilder->createBasicType("f" + to_string(bits), bits, dwarf::DW_ATE_float);
+	} else if (type->isStructTy() && structFields.find(type->getStructName().str()) != structFields.end()) {
+		StructType *record = cast<StructType>(type);
+		const StructLayout *fieldLayout = layout.getStructLayout(record);
+		std::vector<std::string>& names = structFields[record->getName().str()];
+		std::vector<Metadata*> members;
+		for (unsigned i = 0; i < record->getNumElements(); i++) {
+			Type *fieldType = record->getElementType(i);
+			members.push_back(dbuilder->createMemberType(debugFile, names[i], debugFile, 0,
+				layout.getTypeSizeInBits(fieldType), 0, fieldLayout->getElementOffsetInBits(i),
+				DINode::FlagZero, debugType(fieldType)));
+		}
+		result = dbuilder->createStructType(debugFile, record->getName(), debugFile, 0,
+			layout.getTypeSizeInBits(record), 0, DINode::FlagZero, nullptr, dbuilder->getOrCreateArray(members));
+	} else if (type->isVectorTy()) {
+		Metadata *range = dbuilder->getOrCreateSubrange(0, type->getVectorNumElements());
+		result = dbuilder->createVectorType(layout.getTypeSizeInBits(type), 0,
+			debugType(type->getVectorElementType()), dbuilder->getOrCreateArray(range));
+	} else if (type->isArrayTy()) {
+		Metadata *range = dbuilder->getOrCreateSubrange(0, type->getArrayNumElements());
+		result = dbuilder->createArrayType(layout.getTypeSizeInBits(type), 0,
+			debugType(type->getArrayElementType()), dbuilder->getOrCreateArray(range));
+	} else if (type->isPointerTy()) {
+		// functions are only passed around, a plain address is enough for them
+		Type *element = type->getPointerElementType();
+		DIType *pointee = element->isFunctionTy() ? nullptr : debugType(element);
+		result = dbuilder->createPointerType(pointee, layout.getPointerSizeInBits(),
+			0, None, element->isIntegerTy(8) ? "string" : "");
+	} else {
+		result = dbuilder->createUnspecifiedType(getTypeString(type));
+	}
+	debugTypes[type] = result;
+	return result;
+}
+
+/* Subprogram for a function, its body is the innermost scope until debugFunctionEnd */
+void CodeGenContext::debugFunction(Function *function, int line) {
+	if (!dbuilder)
+		return;
+	std::vector<Metadata*> types;
+	Type *returnType = function->getReturnType();
+	types.push_back(returnType->isVoidTy() ? nullptr : debugType(returnType));
+	for (auto &arg : function->args()) {
+		types.push_back(debugType(arg.getType()));
+	}
+	DISubroutineType *ftype = dbuilder->createSubroutineType(dbuilder->getOrCreateTypeArray(types));
+	DISubprogram *subprogram = dbuilder->createFunction(debugFile, function->getName(), StringRef(),
+		debugFile, line, ftype, false, true, line, DINode::FlagPrototyped, false);
+	function->setSubprogram(subprogram);
+	debugScopes.push_back(subprogram);
+	Builder.SetCurrentDebugLocation(DebugLoc::get(line, 0, subprogram));
+}
+
+void CodeGenContext::debugFunctionEnd() {
+	if (!dbuilder)
+		return;
+	dbuilder->finalizeSubprogram(cast<DISubprogram>(debugScopes.back()));
+	debugScopes.pop_back();
+}
+
+/* Instructions built from here on belong to this source position */
+void CodeGenContext::debugLocation(int line, int column) {
+	if (!dbuilder || debugScopes.empty())
+		return;
+	Builder.SetCurrentDebugLocation(DebugLoc::get(line, column, debugScopes.back()));
+}
+
+/* Describe a local (argNo == 0) or argument (argNo counts from 1) living in storage */
+void CodeGenContext::debugVariable(Value *storage, const std::string& name, int line, unsigned argNo) {
+	AllocaInst *alloc = dyn_cast_or_null<AllocaInst>(storage);
+	if (!dbuilder || debugScopes.empty() || !alloc)
+		return;
+	DIScope *scope = debugScopes.back();
+	DIType *type = debugType(alloc->getAllocatedType());
+	DILocalVariable *variable = argNo > 0
+		? dbuilder->createParameterVariable(scope, name, argNo, debugFile, line, type, true)
+		: dbuilder->createAutoVariable(scope, name, debugFile, line, type, true);
+	dbuilder->insertDeclare(alloc, variable, dbuilder->createExpression(),
+		DebugLoc::get(line, 0, scope), Builder.GetInsertBlock());
+}
+
+/* Keep the frame pointer chain in every function defined so far */
+void CodeGenContext::setFramePointers() {
+	if (!keepFramePointers)
+		return;
+	for (Function &function : *module) {
+		if (!function.isDeclaration()) {
+			function.addFnAttr("no-frame-pointer-elim", "true");
+			function.addFnAttr("no-frame-pointer-elim-non-leaf");
+		}
+	}
+}
+
+/* Executes program main function*/
+GenericValue CodeGenContext::runCode() {
+	cout << "Running code...\n";
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+	InitializeNativeTargetAsmParser();
+	ExecutionEngine *ee = EngineBuilder(unique_ptr<Module>(module)).create();
+
+	vector<GenericValue> noargs;
+	GenericValue v = ee->runFunction(mainFunction, noargs);
+  	// ee->freeMachineCodeForFunction(mainFunction);
+  	delete ee;
+  	llvm_shutdown();
+	cout << "Code was run.\n";
+	return v;
+}
+
+/* i8 to i64, u8 to u64 and f32, or one of them after "[]" for an array */
+static Type *numericTypeOf(const std::string& name) {
+	bool isArray = name.compare(0, 2, "[]") == 0;
+	std::string element = isArray ? name.substr(2) : name;
+	Type *type = NULL;
+	if (element == "i8" || element == "u8") {
+		type = Type::getInt8Ty(TheContext);
+	} else if (element == "i16" || element == "u16") {
+		type = Type::getInt16Ty(TheContext);
+	} else if (element == "i32" || element == "u32") {
+		type = Type::getInt32Ty(TheContext);
+	} else if (element == "i64" || element == "u64") {
+		type = Type::getInt64Ty(TheContext);
+	} else if (element == "f32") {
+		type = Type::getFloatTy(TheContext);
+	}
+	if (type != NULL && isArray) {
+		return type->getPointerTo();
+	}
+	return type;
+}
+
+/* u8 to u64, arrays ("[]u8") and vectors ("vec16u8") of them */
+static bool isUnsignedType(const std::string& name) {
+	std::string element = name.compare(0, 2, "[]") == 0 ? name.substr(2) : name;
+	if (element.compare(0, 3, "vec") == 0) {
+		size_t suffix = element.find_first_not_of("0123456789", 3);
+		element = suffix == std::string::npos ? "" : element.substr(suffix);
+	}
+	return element == "u8" || element == "u16" || element == "u32" || element == "u64";
+}
+
+/**
+ * vec<N><lane>: N lanes (a power of two, 2 to 64) where lane is f, i, l or b
+ * for float, int, long or bool, or one of the sized types: vec8f32, vec16u8.
+ */
+static Type *vectorTypeOf(const std::string& name) {
+	if (name.compare(0, 3, "vec") != 0) {
+		return NULL;
+	}
+	size_t suffix = name.find_first_not_of("0123456789", 3);
+	if (suffix == std::string::npos || suffix == 3 || suffix > 5) {
+		return NULL;
+	}
+	unsigned count = stoi(name.substr(3, suffix - 3));
+	if (count < 2 || count > 64 || (count & (count - 1)) != 0) {
+		return NULL;
+	}
+
+	std::string lane = name.substr(suffix);
+	Type *element;
+	if (lane == "f") {
+		element = Type::getDoubleTy(TheContext);
+	} else if (lane == "i") {
+		element = Type::getInt32Ty(TheContext);
+	} else if (lane == "l") {
+		element = Type::getInt64Ty(TheContext);
+	} else if (lane == "b") {
+		element = Type::getInt1Ty(TheContext);
+	} else {
+		element = numericTypeOf(lane);
+	}
+	if (element == NULL || element->isPointerTy()) {
+		return NULL;
+	}
+	return VectorType::get(element, count);
+}
+
+/* Scalar types whose name converts a value when called: u8(x), float(n) */
+static Type *conversionTypeOf(const std::string& name) {
+	if (name == "int") {
+		return Type::getInt32Ty(TheContext);
+	} else if (name == "long") {
+		return Type::getInt64Ty(TheContext);
+	} else if (name == "float") {
+		return Type::getDoubleTy(TheContext);
+	} else if (name == "bool") {
+		return Type::getInt1Ty(TheContext);
+	}
+	Type *type = numericTypeOf(name);
+	if (type != NULL && type->isPointerTy()) {
+		return NULL;
+	}
+	return type;
+}
+
+/* A declared struct by value, or "[]Name" as a pointer to its elements */
+static Type *structTypeOf(const std::string& name) {
+	bool isArray = name.compare(0, 2, "[]") == 0;
+	auto found = structTypes.find(isArray ? name.substr(2) : name);
+	if (found == structTypes.end()) {
+		return Type::getVoidTy(TheContext);
+	}
+	if (isArray) {
+		return found->second->getPointerTo();
+	}
+	return found->second;
+}
+
+/* strview: characters and a length pointing into a string, passed by value */
+static StructType *stringViewType() {
+	static StructType *type = StructType::create(TheContext,
+		{ Type::getInt8PtrTy(TheContext), Type::getInt64Ty(TheContext) }, "strview");
+	return type;
+}
+
+/* strbuf: a growable buffer of the runtime (src/runtime/string.c) */
+static PointerType *stringBuilderType() {
+	static PointerType *type = StructType::create(TheContext, "strbuf")->getPointerTo();
+	return type;
+}
+
+/* file: an input file of the runtime (src/runtime/file.c), mapped or read in chunks */
+static PointerType *fileType() {
+	static PointerType *type = StructType::create(TheContext, "file")->getPointerTo();
+	return type;
+}
+
+/* map[K]V for integer or string keys K and number, bool or string values V */
+static Type *mapTypeOf(const std::string& name) {
+	if (name.compare(0, 4, "map[") != 0) {
+		return NULL;
+	}
+	auto found = mapTypeNames.find(name);
+	if (found != mapTypeNames.end()) {
+		return found->second;
+	}
+	size_t close = name.find(']');
+	if (close == std::string::npos) {
+		return NULL;
+	}
+	std::string keyName = name.substr(4, close - 4);
+	std::string valueName = name.substr(close + 1);
+	Type *key = keyName == "string" ? Type::getInt8PtrTy(TheContext) : conversionTypeOf(keyName);
+	Type *value = valueName == "string" ? Type::getInt8PtrTy(TheContext) : conversionTypeOf(valueName);
+	if (key == NULL || key->isIntegerTy(1) || key->isFloatingPointTy()) {
+		ast_error("map keys must be integers or strings, not " + keyName);
+		return NULL;
+	}
+	if (value == NULL) {
+		ast_error("map values must be numbers, bools or strings, not " + valueName);
+		return NULL;
+	}
+
+	Type *type = StructType::create(TheContext, name)->getPointerTo();
+	mapTypes[type] = { key, value, isUnsignedType(keyName), isUnsignedType(valueName) };
+	mapTypeNames[name] = type;
+	return type;
+}
+
+/* chan[T] for number, bool or string elements T */
+static Type *channelTypeOf(const std::string& name) {
+	if (name.compare(0, 5, "chan[") != 0 || name.back() != ']') {
+		return NULL;
+	}
+	auto found = channelTypeNames.find(name);
+	if (found != channelTypeNames.end()) {
+		return found->second;
+	}
+	std::string elementName = name.substr(5, name.size() - 6);
+	Type *element = elementName == "string" ? Type::getInt8PtrTy(TheContext) : conversionTypeOf(elementName);
+	if (element == NULL) {
+		ast_error("channels carry numbers, bools or strings, not " + elementName);
+		return NULL;
+	}
+
+	Type *type = StructType::create(TheContext, name)->getPointerTo();
+	channelTypes[type] = { element, isUnsignedType(elementName) };
+	channelTypeNames[name] = type;
+	return type;
+}
+
+/* task[T] of an async function returning resultName */
+static Type *taskTypeOf(const std::string& resultName, Type *result) {
+	std::string name = "task[" + resultName + "]";
+	auto found = taskTypeNames.find(name);
+	if (found != taskTypeNames.end()) {
+		return found->second;
+	}
+	Type *type = StructType::create(TheContext, name)->getPointerTo();
+	taskTypes[type] = { result, isUnsignedType(resultName) };
+	taskTypeNames[name] = type;
+	return type;
+}
+
+/* Returns a LLVM type based on the identifier */
+static Type *typeOf(NIdentifier type) {
+	if (type.name.compare("int") == 0) {
+		return Type::getInt32Ty(TheContext);
+	} else if (type.name.compare("[]int") == 0) {
+		return Type::getInt32PtrTy(TheContext);
+	} else if (type.name.compare("long") == 0) {
+		return Type::getInt64Ty(TheContext);
+	} else if (type.name.compare("[]long") == 0) {
+		return Type::getInt64PtrTy(TheContext);
+	} else if (type.name.compare("float") == 0) {
+		return Type::getDoubleTy(TheContext);
+	} else if (type.name.compare("[]float") == 0) {
+		return Type::getDoublePtrTy(TheContext);
+	} else if (type.name.compare("string") == 0) {
+		return Type::getInt8PtrTy(TheContext);
+	} else if (type.name.compare("[]string") == 0) {
+		return Type::getInt8PtrTy(TheContext)->getPointerTo();
+	} else if (type.name.compare("bool") == 0) {
+		return Type::getInt1Ty(TheContext);
+	} else if (type.name.compare("[]bool") == 0) {
+		return Type::getInt1PtrTy(TheContext);
+	} else if (type.name.compare("void") == 0) {
+		return Type::getVoidTy(TheContext);
+	}
+
+	if (Type *numeric = numericTypeOf(type.name)) {
+		return numeric;
+	}
+	if (Type *vector = vectorTypeOf(type.name)) {
+		return vector;
+	}
+	if (Type *map = mapTypeOf(type.name)) {
+		return map;
+	}
+	if (Type *channel = channelTypeOf(type.name)) {
+		return channel;
+	}
+	if (type.name == "strview") {
+		return stringViewType();
+	} else if (type.name == "strbuf") {
+		return stringBuilderType();
+	} else if (type.name == "file") {
+		return fileType();
+	}
+	return structTypeOf(type.name);
+}
+
+/* Like typeOf(type), a "func" type also needs its result and parameter types */
+static Type *typeOf(NIdentifier type, NIdentifier funcType, IdentifierList funcParams) {
+	if (type.name.compare("func") == 0) {
+		std::vector<Type*> argTypes;
+		for (auto it = funcParams.begin(); it != funcParams.end(); it++) {
+			cout << "function parameter argument: " << (**it).name << endl;
+			/* fix: recursion function type (need a scalable type system) */
+			argTypes.push_back(typeOf(**it));
+		}
+		FunctionType *ftype = FunctionType::get(typeOf(funcType), makeArrayRef(argTypes), false);
+		return ftype->getPointerTo();
+	}
+	return typeOf(type);
+}
+
+static Value* getArrayIndex(Value* array,  Value* index) {
+	std::vector<Value*> indices;
+
+	cout << "array type is: " << getTypeString(array) << endl;
+	if (ends_with(getTypeString(array), "**")) {
+		array = Builder.CreateLoad(array);
+	} else {
+		indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), 0, false));
+	}
+	indices.push_back(index);
+
+	return Builder.CreateInBoundsGEP(array, makeArrayRef(indices), "");
+}
+
+/* Position of field in a declared struct type, -1 if there is no such field */
+static int structFieldIndex(Type* type, const std::string& field) {
+	StructType *record = dyn_cast<StructType>(type);
+	if (!record || structFields.find(record->getName().str()) == structFields.end()) {
+		ast_error("cannot access field " + field + " of " + getTypeString(type));
+		return -1;
+	}
+	std::vector<std::string>& names = structFields[record->getName().str()];
+	auto found = std::find(names.begin(), names.end(), field);
+	if (found == names.end()) {
+		ast_error("struct " + record->getName().str() + " has no field " + field);
+		return -1;
+	}
+	return found - names.begin();
+}
+
+/* Address of p.x or a[i].x, for an @soa array the element of column a.x */
+static Value* getFieldAddress(CodeGenContext& context, NIdentifier& id) {
+	std::string column = id.name + "." + id.field;
+	if (context.locals().find(column) != context.locals().end()) {
+		Value* index = id.index ? id.index->codeGen(context) : ConstantInt::get(Type::getInt64Ty(TheContext), 0, true);
+		Value* element = getArrayIndex(context.locals()[column], index);
+		context.setUnsigned(element, context.isUnsigned(context.locals()[column]));
+		return element;
+	}
+	if (context.locals().find(id.name) == context.locals().end()) {
+		cerr << "undeclared variable " << id.name << endl;
+		return NULL;
+	}
+
+	Value* record = context.locals()[id.name];
+	if (id.index) {
+		record = getArrayIndex(record, id.index->codeGen(context));
+	}
+	Type* recordType = record->getType()->getPointerElementType();
+	int field = structFieldIndex(recordType, id.field);
+	if (field < 0) {
+		return NULL;
+	}
+	Value* address = Builder.CreateStructGEP(recordType, record, field);
+	std::string qualified = recordType->getStructName().str() + "." + id.field;
+	context.setUnsigned(address, unsignedFields.find(qualified) != unsignedFields.end());
+	return address;
+}
+
+/**
+ * value marked unsigned. A constant is first turned into an instruction of
+ * its own: constants are shared, one 3u32 must not make every i32 3 of the
+ * module unsigned. Optimization folds the instruction away again.
+ */
+static Value* unsignedValue(CodeGenContext& context, Value* value) {
+	if (!value->getType()->isIntOrIntVectorTy()) {
+		return value;
+	}
+	if (isa<Constant>(value)) {
+		value = Builder.Insert(BinaryOperator::CreateOr(value, Constant::getNullValue(value->getType())));
+	}
+	context.setUnsigned(value);
+	return value;
+}
+
+/* The constant behind an unsignedValue, value itself otherwise */
+static Value* constantOf(Value* value) {
+	BinaryOperator* wrap = dyn_cast<BinaryOperator>(value);
+	if (wrap && wrap->getOpcode() == Instruction::Or && isa<Constant>(wrap->getOperand(0))
+		&& isa<Constant>(wrap->getOperand(1)) && cast<Constant>(wrap->getOperand(1))->isNullValue()) {
+		return wrap->getOperand(0);
+	}
+	return value;
+}
+
+/* Convert value to type. Integers extend by the sign of value, the result has the sign of the target */
+static Value* convertValue(CodeGenContext& context, Value* value, Type* type, bool targetUnsigned) {
+	Type* from = value->getType();
+	bool fromUnsigned = context.isUnsigned(value) || from->isIntegerTy(1);
+	Value* result;
+	if (from == type) {
+		result = value;
+	} else if (type->isIntegerTy(1) && from->isIntegerTy()) {
+		result = Builder.CreateICmpNE(value, ConstantInt::get(from, 0));
+	} else if (type->isIntegerTy(1) && from->isFloatingPointTy()) {
+		result = Builder.CreateFCmpUNE(value, ConstantFP::get(from, 0.0));
+	} else if (type->isIntegerTy() && from->isIntegerTy()) {
+		result = Builder.CreateIntCast(value, type, !fromUnsigned);
+	} else if (type->isFloatingPointTy() && from->isIntegerTy()) {
+		result = fromUnsigned ? Builder.CreateUIToFP(value, type) : Builder.CreateSIToFP(value, type);
+	} else if (type->isIntegerTy() && from->isFloatingPointTy()) {
+		result = targetUnsigned ? Builder.CreateFPToUI(value, type) : Builder.CreateFPToSI(value, type);
+	} else if (type->isFloatingPointTy() && from->isFloatingPointTy()) {
+		result = Builder.CreateFPCast(value, type);
+	} else {
+		ast_error("cannot convert " + getTypeString(value) + " to " + getTypeString(type) + " !");
+		return NULL;
+	}
+	if (targetUnsigned) {
+		return unsignedValue(context, result);
+	}
+	context.setUnsigned(result, false);
+	return result;
+}
+
+/**
+ * A plain literal takes the type of what it meets when its value fits
+ * there: 200 next to a u8 is a u8, 0.5 next to a f32 is a f32.
+ */
+static Value* adaptLiteral(CodeGenContext& context, Value* value, Type* type, bool targetUnsigned) {
+	if (value == NULL || value->getType() == type) {
+		return value;
+	}
+	if (ConstantInt* integer = dyn_cast<ConstantInt>(value)) {
+		if (!type->isIntegerTy() || type->isIntegerTy(1) || integer->getType()->isIntegerTy(1)) {
+			return value;
+		}
+		APInt literal = integer->getValue();
+		int64_t number = literal.getSExtValue();
+		unsigned bits = type->getIntegerBitWidth();
+		bool fits;
+		if (targetUnsigned) {
+			fits = number >= 0 && (bits >= 64 || (uint64_t)number < (1ULL << bits));
+		} else {
+			fits = bits >= 64 || (number >= -(1LL << (bits - 1)) && number < (1LL << (bits - 1)));
+		}
+		if (!fits) {
+			return value;
+		}
+		// the signedness comes from what the literal meets, it is not recorded on the constant
+		return ConstantInt::get(type, number, true);
+	}
+	if (ConstantFP* real = dyn_cast<ConstantFP>(value)) {
+		if (!type->isFloatingPointTy()) {
+			return value;
+		}
+		APFloat number = real->getValueAPF();
+		bool losesInfo;
+		number.convert(type->getFltSemantics(), APFloat::rmNearestTiesToEven, &losesInfo);
+		return ConstantFP::get(TheContext, number);
+	}
+	return value;
+}
+
+/* C default argument promotions for the variadic part of a call such as println */
+static Value* promoteVararg(CodeGenContext& context, Value* value) {
+	Type* type = value->getType();
+	if (type->isIntegerTy() && !type->isIntegerTy(1) && type->getIntegerBitWidth() < 32) {
+		return convertValue(context, value, Type::getInt32Ty(TheContext), false);
+	}
+	if (type->isFloatTy()) {
+		return Builder.CreateFPExt(value, Type::getDoubleTy(TheContext));
+	}
+	return value;
+}
+
+/* vec4f(x) fills every lane with x, vec4f(a, b, c, d) sets the lanes in order */
+static Value* vectorConstruct(CodeGenContext& context, VectorType* type, bool isUnsigned, std::vector<Value*>& args) {
+	unsigned lanes = type->getNumElements();
+	for (size_t i = 0; i < args.size(); i++) {
+		args[i] = adaptLiteral(context, args[i], type->getElementType(), isUnsigned);
+	}
+	if (args.size() == 1 && args[0]->getType() == type->getElementType()) {
+		return Builder.CreateVectorSplat(lanes, args[0]);
+	}
+	if (args.size() != lanes) {
+		ast_error(getTypeString(type) + " needs 1 or " + to_string(lanes) + " values");
+		return NULL;
+	}
+
+	Value* vector = UndefValue::get(type);
+	for (unsigned i = 0; i < lanes; i++) {
+		if (args[i]->getType() != type->getElementType()) {
+			ast_error("cannot put " + getTypeString(args[i]) + " into " + getTypeString(type) + " !");
+			return NULL;
+		}
+		vector = Builder.CreateInsertElement(vector, args[i], Builder.getInt32(i));
+	}
+	return vector;
+}
+
+/* Builtins report a wrong argument count the same way */
+static bool checkBuiltinArgs(const std::string& name, std::vector<Value*>& args, size_t min, size_t max) {
+	if (args.size() < min || args.size() > max) {
+		ast_error(name + " takes " + to_string(min) + (min == max ? "" : " to " + to_string(max)) + " arguments");
+		return false;
+	}
+	return true;
+}
+
+static bool checkVector(const std::string& name, Value* value) {
+	if (!value->getType()->isVectorTy()) {
+		ast_error(name + " needs a vector, not " + getTypeString(value));
+		return false;
+	}
+	return true;
+}
+
+/* extract(v, i): lane i of v */
+static Value* vectorExtract(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("extract", args, 2, 2) || !checkVector("extract", args[0])) {
+		return NULL;
+	}
+	Value* lane = Builder.CreateExtractElement(args[0], args[1]);
+	context.setUnsigned(lane, context.isUnsigned(args[0]));
+	return lane;
+}
+
+/* insert(v, i, x): v with lane i replaced by x */
+static Value* vectorInsert(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("insert", args, 3, 3) || !checkVector("insert", args[0])) {
+		return NULL;
+	}
+	args[2] = adaptLiteral(context, args[2], args[0]->getType()->getVectorElementType(), context.isUnsigned(args[0]));
+	if (args[2]->getType() != args[0]->getType()->getVectorElementType()) {
+		ast_error("cannot insert " + getTypeString(args[2]) + " into " + getTypeString(args[0]) + " !");
+		return NULL;
+	}
+	Value* vector = Builder.CreateInsertElement(args[0], args[2], args[1]);
+	context.setUnsigned(vector, context.isUnsigned(args[0]));
+	return vector;
+}
+
+/**
+ * shuffle(a, 3, 2, 1, 0) picks lanes of a, shuffle(a, b, 0, 4, 1, 5) picks
+ * lanes of a and b (b's lanes numbered after a's). Lanes are constants and
+ * their count is the length of the result.
+ */
+static Value* vectorShuffle(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("shuffle", args, 2, 130) || !checkVector("shuffle", args[0])) {
+		return NULL;
+	}
+	Value* second = UndefValue::get(args[0]->getType());
+	size_t first = 1;
+	if (args[1]->getType() == args[0]->getType()) {
+		second = args[1];
+		first = 2;
+	}
+
+	if (args.size() == first) {
+		ast_error("shuffle needs at least one lane after its vectors");
+		return NULL;
+	}
+
+	// only a second vector adds lanes to pick from, the undef it stands in for has none
+	unsigned lanes = args[0]->getType()->getVectorNumElements();
+	unsigned limit = first == 2 ? 2 * lanes : lanes;
+	std::vector<uint32_t> mask;
+	for (size_t i = first; i < args.size(); i++) {
+		ConstantInt* lane = dyn_cast<ConstantInt>(constantOf(args[i]));
+		if (lane == NULL || lane->getZExtValue() >= limit) {
+			ast_error("shuffle lanes must be constants below " + to_string(limit));
+			return NULL;
+		}
+		mask.push_back(lane->getZExtValue());
+	}
+	Value* vector = Builder.CreateShuffleVector(args[0], second, mask);
+	context.setUnsigned(vector, context.isUnsigned(args[0]));
+	return vector;
+}
+
+/* select(m, a, b): lanes of a where the mask m is set, of b elsewhere */
+static Value* vectorSelect(CodeGenContext& context, std::vector<Value*>& args) {
+	if (args.size() != 3 || args[0]->getType()->getScalarType() != Type::getInt1Ty(TheContext)
+		|| args[1]->getType() != args[2]->getType()) {
+		ast_error("select takes a mask and two values of the same type");
+		return NULL;
+	}
+	Value* result = Builder.CreateSelect(args[0], args[1], args[2]);
+	context.setUnsigned(result, context.isUnsigned(args[1]) || context.isUnsigned(args[2]));
+	return result;
+}
+
+/* Horizontal reduction as a shuffle tree, log2(lanes) vector operations and one extract */
+static Value* vectorReduce(CodeGenContext& context, const std::string& name, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs(name, args, 1, 1) || !checkVector(name, args[0])) {
+		return NULL;
+	}
+	Value* vector = args[0];
+	VectorType* type = cast<VectorType>(vector->getType());
+	bool fp = type->getElementType()->isFloatingPointTy();
+	bool isUnsigned = context.isUnsigned(vector);
+	if (type->getElementType()->isIntegerTy(1)) {
+		ast_error(name + " needs a vector of numbers");
+		return NULL;
+	}
+
+	unsigned lanes = type->getNumElements();
+	for (unsigned half = lanes / 2; half > 0; half /= 2) {
+		// move the upper half down and combine it with the lower half
+		std::vector<uint32_t> mask;
+		for (unsigned i = 0; i < lanes; i++) {
+			mask.push_back(i < half ? i + half : i);
+		}
+		Value* upper = Builder.CreateShuffleVector(vector, UndefValue::get(type), mask);
+		if (name == "hsum") {
+			vector = fp ? Builder.CreateFAdd(vector, upper) : Builder.CreateAdd(vector, upper);
+		} else {
+			Value* less;
+			if (fp) {
+				less = Builder.CreateFCmpOLT(vector, upper);
+			} else {
+				less = isUnsigned ? Builder.CreateICmpULT(vector, upper) : Builder.CreateICmpSLT(vector, upper);
+			}
+			vector = name == "hmin" ? Builder.CreateSelect(less, vector, upper) : Builder.CreateSelect(less, upper, vector);
+		}
+	}
+	Value* result = Builder.CreateExtractElement(vector, Builder.getInt32(0));
+	context.setUnsigned(result, isUnsigned);
+	return result;
+}
+
+static Value* vectorSum(CodeGenContext& context, std::vector<Value*>& args) {
+	return vectorReduce(context, "hsum", args);
+}
+
+static Value* vectorMin(CodeGenContext& context, std::vector<Value*>& args) {
+	return vectorReduce(context, "hmin", args);
+}
+
+static Value* vectorMax(CodeGenContext& context, std::vector<Value*>& args) {
+	return vectorReduce(context, "hmax", args);
+}
+
+/* Address of array[index] as a pointer to lanes elements, the element must be a number */
+static Value* vectorAddress(const std::string& name, Value* array, Value* index, unsigned lanes) {
+	PointerType* pointer = dyn_cast<PointerType>(array->getType());
+	if (pointer == NULL || pointer->getElementType()->isIntegerTy(1)
+		|| !pointer->getElementType()->isSingleValueType() || pointer->getElementType()->isPointerTy()
+		|| !index->getType()->isIntegerTy()) {
+		ast_error(name + " needs an array of int, long or float and an index");
+		return NULL;
+	}
+	Type* type = VectorType::get(pointer->getElementType(), lanes);
+	return Builder.CreateBitCast(Builder.CreateInBoundsGEP(array, index), type->getPointerTo());
+}
+
+/* Arrays only guarantee the alignment of their elements */
+static unsigned vectorAlignment(Value* address) {
+	return address->getType()->getPointerElementType()->getScalarSizeInBits() / 8;
+}
+
+/* Mask lanes must be bool and as many as the vector has */
+static bool checkMask(const std::string& name, Value* mask, unsigned lanes) {
+	if (!mask->getType()->isVectorTy() || mask->getType()->getVectorNumElements() != lanes
+		|| !mask->getType()->getVectorElementType()->isIntegerTy(1)) {
+		ast_error(name + " mask must be a vec" + to_string(lanes) + "b");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * vload(a, i, 4) loads a[i] to a[i + 3] as a vector, vload(a, i, mask) loads
+ * only the lanes set in mask (as many lanes as the mask has, zero elsewhere).
+ */
+static Value* vectorLoad(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("vload", args, 3, 3)) {
+		return NULL;
+	}
+	ConstantInt* width = dyn_cast<ConstantInt>(constantOf(args[2]));
+	unsigned lanes = width ? width->getZExtValue() : 0;
+	if (width == NULL && args[2]->getType()->isVectorTy()) {
+		lanes = args[2]->getType()->getVectorNumElements();
+	}
+	if (lanes < 2 || lanes > 64 || (lanes & (lanes - 1)) != 0) {
+		ast_error("vload needs a constant lane count (2 to 64, a power of two) or a mask");
+		return NULL;
+	}
+
+	Value* address = vectorAddress("vload", args[0], args[1], lanes);
+	if (address == NULL) {
+		return NULL;
+	}
+	unsigned align = vectorAlignment(address);
+	Value* vector;
+	if (width) {
+		vector = Builder.CreateAlignedLoad(address, align);
+	} else {
+		if (!checkMask("vload", args[2], lanes)) {
+			return NULL;
+		}
+		Type* type = address->getType()->getPointerElementType();
+		vector = Builder.CreateMaskedLoad(address, align, args[2], Constant::getNullValue(type));
+	}
+	context.setUnsigned(vector, context.isUnsigned(args[0]));
+	return vector;
+}
+
+/* vstore(a, i, v) stores v to a[i] onwards, vstore(a, i, v, mask) only the lanes set in mask */
+static Value* vectorStore(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("vstore", args, 3, 4)) {
+		return NULL;
+	}
+	VectorType* type = dyn_cast<VectorType>(args[2]->getType());
+	if (type == NULL || !args[0]->getType()->isPointerTy()
+		|| type->getElementType() != args[0]->getType()->getPointerElementType()) {
+		ast_error("vstore needs a vector of the array's element type");
+		return NULL;
+	}
+
+	Value* address = vectorAddress("vstore", args[0], args[1], type->getNumElements());
+	if (address == NULL) {
+		return NULL;
+	}
+	unsigned align = vectorAlignment(address);
+	if (args.size() == 3) {
+		return Builder.CreateAlignedStore(args[2], address, align);
+	}
+	if (!checkMask("vstore", args[3], type->getNumElements())) {
+		return NULL;
+	}
+	return Builder.CreateMaskedStore(args[2], address, align, args[3]);
+}
+
+/* Element type of an array argument, NULL when value is not an array */
+static Type* arrayElement(const std::string& name, Value* array) {
+	PointerType* pointer = dyn_cast<PointerType>(array->getType());
+	if (pointer == NULL || isa<Function>(array) || pointer->getElementType()->isFunctionTy()) {
+		ast_error(name + " needs an array, not " + getTypeString(array));
+		return NULL;
+	}
+	return pointer->getElementType();
+}
+
+/**
+ * Element count of a bulk builtin as a long: the explicit count when there
+ * is one, else the declared size of a fixed array (a local or a @soa column).
+ * []T parameters carry no size and need the count.
+ */
+static Value* arrayLength(CodeGenContext& context, const std::string& name, Value* array, Value* count) {
+	Type* i64 = Type::getInt64Ty(TheContext);
+	if (count) {
+		if (!count->getType()->isIntegerTy() || count->getType()->isIntegerTy(1)) {
+			ast_error(name + " length must be an integer, not " + getTypeString(count));
+			return NULL;
+		}
+		return count->getType() == i64 ? count : convertValue(context, count, i64, false);
+	}
+	if (GEPOperator* first = dyn_cast<GEPOperator>(array)) {
+		AllocaInst* alloca = dyn_cast<AllocaInst>(first->getPointerOperand());
+		if (alloca && alloca->getAllocatedType()->isArrayTy()) {
+			return ConstantInt::get(i64, alloca->getAllocatedType()->getArrayNumElements());
+		}
+	}
+	ast_error(name + " needs a length for an array without a fixed size");
+	return NULL;
+}
+
+/* Size of length elements in bytes */
+static Value* arrayBytes(Type* element, Value* length) {
+	return Builder.CreateMul(length, ConstantExpr::getSizeOf(element));
+}
+
+/* Arrays only guarantee the alignment of their elements, structs are taken as bytes */
+static unsigned elementAlignment(Type* element) {
+	unsigned bytes = element->getScalarSizeInBits() / 8;
+	return bytes ? bytes : 1;
+}
+
+/* The byte memset repeats to fill with value, NULL when value is not one byte repeated */
+static Value* fillByte(Value* value) {
+	Type* type = value->getType();
+	if (type->isIntegerTy(8)) {
+		return value;
+	}
+	value = constantOf(value);
+	if (Constant* constant = dyn_cast<Constant>(value)) {
+		if (constant->isNullValue()) {
+			return Builder.getInt8(0);
+		}
+		ConstantInt* integer = dyn_cast<ConstantInt>(value);
+		if (integer && type->getIntegerBitWidth() % 8 == 0 && integer->getValue().isSplat(8)) {
+			return Builder.getInt8(integer->getValue().trunc(8).getZExtValue());
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Call the runtime kernel of op for the element type of array, named
+ * __coo_array_<op>_<i8|u8|...|f64> (src/runtime/array.c).
+ */
+static Value* callArrayKernel(CodeGenContext& context, const std::string& op, Value* array, Type* result,
+	std::vector<Value*> args) {
+	Type* element = array->getType()->getPointerElementType();
+	std::string suffix;
+	if (element->isIntegerTy(8) || element->isIntegerTy(16) || element->isIntegerTy(32) || element->isIntegerTy(64)) {
+		suffix = (context.isUnsigned(array) ? "u" : "i") + to_string(element->getIntegerBitWidth());
+	} else if (element->isFloatTy()) {
+		suffix = "f32";
+	} else if (element->isDoubleTy()) {
+		suffix = "f64";
+	} else {
+		ast_error(op + " needs an array of numbers, not " + getTypeString(array));
+		return NULL;
+	}
+
+	std::vector<Type*> params;
+	for (Value* arg : args) {
+		params.push_back(arg->getType());
+	}
+	FunctionType* ftype = FunctionType::get(result, params, false);
+	Constant* kernel = context.module->getOrInsertFunction("__coo_array_" + op + "_" + suffix, ftype);
+	return Builder.CreateCall(kernel, args);
+}
+
+/* fill(a, v[, n]) sets every element to v: a memset when v is one byte repeated, else a store loop */
+static Value* arrayFill(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("fill", args, 2, 3)) {
+		return NULL;
+	}
+	Type* element = arrayElement("fill", args[0]);
+	Value* length = element ? arrayLength(context, "fill", args[0], args.size() > 2 ? args[2] : NULL) : NULL;
+	if (length == NULL) {
+		return NULL;
+	}
+	Value* value = adaptLiteral(context, args[1], element, context.isUnsigned(args[0]));
+	if (value->getType() != element) {
+		ast_error("cannot fill " + getTypeString(args[0]) + " with " + getTypeString(value) + " !");
+		return NULL;
+	}
+	if (Value* byte = fillByte(value)) {
+		Builder.CreateMemSet(args[0], byte, arrayBytes(element, length), elementAlignment(element));
+		return args[0];
+	}
+
+	// a plain counted loop, the loop vectorizer turns it into vector stores
+	Function* function = Builder.GetInsertBlock()->getParent();
+	BasicBlock* entry = Builder.GetInsertBlock();
+	BasicBlock* loop = BasicBlock::Create(TheContext, "fill", function);
+	BasicBlock* after = BasicBlock::Create(TheContext, "afterfill", function);
+	Value* zero = ConstantInt::get(length->getType(), 0);
+	Builder.CreateCondBr(Builder.CreateICmpSGT(length, zero), loop, after);
+
+	Builder.SetInsertPoint(loop);
+	PHINode* i = Builder.CreatePHI(length->getType(), 2);
+	i->addIncoming(zero, entry);
+	Builder.CreateStore(value, Builder.CreateInBoundsGEP(args[0], i));
+	Value* next = Builder.CreateAdd(i, ConstantInt::get(length->getType(), 1));
+	i->addIncoming(next, loop);
+	Builder.CreateCondBr(Builder.CreateICmpSLT(next, length), loop, after);
+
+	Builder.SetInsertPoint(after);
+	return args[0];
+}
+
+/* copy(dst, src[, n]) copies n elements (all of dst by default) with a memcpy, the arrays must not overlap */
+static Value* arrayCopy(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("copy", args, 2, 3)) {
+		return NULL;
+	}
+	Type* element = arrayElement("copy", args[0]);
+	if (element == NULL || arrayElement("copy", args[1]) == NULL) {
+		return NULL;
+	}
+	if (args[1]->getType() != args[0]->getType()) {
+		ast_error("cannot copy " + getTypeString(args[1]) + " to " + getTypeString(args[0]) + " !");
+		return NULL;
+	}
+	Value* length = arrayLength(context, "copy", args[0], args.size() > 2 ? args[2] : NULL);
+	if (length == NULL) {
+		return NULL;
+	}
+	Builder.CreateMemCpy(args[0], args[1], arrayBytes(element, length), elementAlignment(element));
+	return args[0];
+}
+
+/* sum(a[, n]), min(a[, n]) and max(a[, n]) run the vectorized runtime reductions, 0 for no elements */
+static Value* arrayReduce(CodeGenContext& context, const std::string& name, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs(name, args, 1, 2)) {
+		return NULL;
+	}
+	Type* element = arrayElement(name, args[0]);
+	Value* length = element ? arrayLength(context, name, args[0], args.size() > 1 ? args[1] : NULL) : NULL;
+	if (length == NULL) {
+		return NULL;
+	}
+	Value* result = callArrayKernel(context, name, args[0], element, {args[0], length});
+	if (result) {
+		context.setUnsigned(result, context.isUnsigned(args[0]));
+	}
+	return result;
+}
+
+static Value* arraySum(CodeGenContext& context, std::vector<Value*>& args) {
+	return arrayReduce(context, "sum", args);
+}
+
+static Value* arrayMin(CodeGenContext& context, std::vector<Value*>& args) {
+	return arrayReduce(context, "min", args);
+}
+
+static Value* arrayMax(CodeGenContext& context, std::vector<Value*>& args) {
+	return arrayReduce(context, "max", args);
+}
+
+/* find(a, v[, n]): index of the first element equal to v, -1 if there is none */
+static Value* arrayFind(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("find", args, 2, 3)) {
+		return NULL;
+	}
+	Type* element = arrayElement("find", args[0]);
+	Value* length = element ? arrayLength(context, "find", args[0], args.size() > 2 ? args[2] : NULL) : NULL;
+	if (length == NULL) {
+		return NULL;
+	}
+	Value* value = adaptLiteral(context, args[1], element, context.isUnsigned(args[0]));
+	if (value->getType() != element) {
+		ast_error("cannot find " + getTypeString(value) + " in " + getTypeString(args[0]) + " !");
+		return NULL;
+	}
+	return callArrayKernel(context, "find", args[0], Type::getInt32Ty(TheContext), {args[0], length, value});
+}
+
+/**
+ * Heapsort specialized for one comparator, __coo_sort_<comparator>(a, n).
+ * The comparator is called directly rather than through a pointer as qsort
+ * would, so the inliner folds it into the sift loop. compare(x, y) is true
+ * when x may come before y, either < or <= works.
+ */
+static Function* comparatorSort(CodeGenContext& context, Function* compare, Type* element) {
+	std::string name = "__coo_sort_" + compare->getName().str();
+	if (Function* existing = context.module->getFunction(name)) {
+		return existing;
+	}
+	compare->addFnAttr(Attribute::InlineHint);
+
+	Type* i64 = Type::getInt64Ty(TheContext);
+	Type* array = element->getPointerTo();
+	IRBuilder<> b(TheContext);
+
+	// sift(a, root, end): move a[root] down until neither child comes after it
+	FunctionType* siftType = FunctionType::get(Type::getVoidTy(TheContext), {array, i64, i64}, false);
+	Function* sift = Function::Create(siftType, GlobalValue::InternalLinkage, name + ".sift", context.module);
+	{
+		auto arg = sift->arg_begin();
+		Value* a = &*arg++;
+		Value* start = &*arg++;
+		Value* end = &*arg;
+		BasicBlock* entry = BasicBlock::Create(TheContext, "entry", sift);
+		BasicBlock* loop = BasicBlock::Create(TheContext, "loop", sift);
+		BasicBlock* pick = BasicBlock::Create(TheContext, "pick", sift);
+		BasicBlock* sibling = BasicBlock::Create(TheContext, "sibling", sift);
+		BasicBlock* check = BasicBlock::Create(TheContext, "check", sift);
+		BasicBlock* swap = BasicBlock::Create(TheContext, "swap", sift);
+		BasicBlock* done = BasicBlock::Create(TheContext, "done", sift);
+
+		b.SetInsertPoint(entry);
+		b.CreateBr(loop);
+
+		b.SetInsertPoint(loop);
+		PHINode* root = b.CreatePHI(i64, 2);
+		root->addIncoming(start, entry);
+		Value* child = b.CreateAdd(b.CreateShl(root, 1), b.getInt64(1));
+		b.CreateCondBr(b.CreateICmpSLT(child, end), pick, done);
+
+		b.SetInsertPoint(pick);
+		Value* right = b.CreateAdd(child, b.getInt64(1));
+		b.CreateCondBr(b.CreateICmpSLT(right, end), sibling, check);
+
+		b.SetInsertPoint(sibling);
+		Value* rightLater = b.CreateCall(compare, {b.CreateLoad(b.CreateInBoundsGEP(a, child)),
+			b.CreateLoad(b.CreateInBoundsGEP(a, right))});
+		Value* later = b.CreateSelect(rightLater, right, child);
+		b.CreateBr(check);
+
+		b.SetInsertPoint(check);
+		PHINode* largest = b.CreatePHI(i64, 2);
+		largest->addIncoming(child, pick);
+		largest->addIncoming(later, sibling);
+		Value* rootAddress = b.CreateInBoundsGEP(a, root);
+		Value* childAddress = b.CreateInBoundsGEP(a, largest);
+		Value* rootValue = b.CreateLoad(rootAddress);
+		Value* childValue = b.CreateLoad(childAddress);
+		b.CreateCondBr(b.CreateCall(compare, {rootValue, childValue}), swap, done);
+
+		b.SetInsertPoint(swap);
+		b.CreateStore(childValue, rootAddress);
+		b.CreateStore(rootValue, childAddress);
+		root->addIncoming(largest, swap);
+		b.CreateBr(loop);
+
+		b.SetInsertPoint(done);
+		b.CreateRetVoid();
+	}
+
+	// sort(a, n): heapify, then move the root behind the shrinking heap
+	FunctionType* sortType = FunctionType::get(Type::getVoidTy(TheContext), {array, i64}, false);
+	Function* sort = Function::Create(sortType, GlobalValue::InternalLinkage, name, context.module);
+	{
+		auto arg = sort->arg_begin();
+		Value* a = &*arg++;
+		Value* n = &*arg;
+		BasicBlock* entry = BasicBlock::Create(TheContext, "entry", sort);
+		BasicBlock* heapify = BasicBlock::Create(TheContext, "heapify", sort);
+		BasicBlock* heapifyBody = BasicBlock::Create(TheContext, "heapify.body", sort);
+		BasicBlock* extract = BasicBlock::Create(TheContext, "extract", sort);
+		BasicBlock* extractBody = BasicBlock::Create(TheContext, "extract.body", sort);
+		BasicBlock* done = BasicBlock::Create(TheContext, "done", sort);
+
+		b.SetInsertPoint(entry);
+		Value* last = b.CreateSub(b.CreateSDiv(n, b.getInt64(2)), b.getInt64(1));
+		b.CreateBr(heapify);
+
+		b.SetInsertPoint(heapify);
+		PHINode* i = b.CreatePHI(i64, 2);
+		i->addIncoming(last, entry);
+		b.CreateCondBr(b.CreateICmpSGE(i, b.getInt64(0)), heapifyBody, extract);
+
+		b.SetInsertPoint(heapifyBody);
+		b.CreateCall(sift, {a, i, n});
+		i->addIncoming(b.CreateSub(i, b.getInt64(1)), heapifyBody);
+		b.CreateBr(heapify);
+
+		b.SetInsertPoint(extract);
+		PHINode* end = b.CreatePHI(i64, 2);
+		end->addIncoming(b.CreateSub(n, b.getInt64(1)), heapify);
+		b.CreateCondBr(b.CreateICmpSGT(end, b.getInt64(0)), extractBody, done);
+
+		b.SetInsertPoint(extractBody);
+		Value* endAddress = b.CreateInBoundsGEP(a, end);
+		Value* top = b.CreateLoad(a);
+		b.CreateStore(b.CreateLoad(endAddress), a);
+		b.CreateStore(top, endAddress);
+		b.CreateCall(sift, {a, b.getInt64(0), end});
+		end->addIncoming(b.CreateSub(end, b.getInt64(1)), extractBody);
+		b.CreateBr(extract);
+
+		b.SetInsertPoint(done);
+		b.CreateRetVoid();
+	}
+	return sort;
+}
+
+/**
+ * sort(a[, n]) sorts ascending in the runtime (radix sort for integers,
+ * introsort for floats), sort(a[, n], cmp) with a function or lambda as the
+ * order through a heapsort generated for cmp.
+ */
+static Value* arraySort(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("sort", args, 1, 3)) {
+		return NULL;
+	}
+	Type* element = arrayElement("sort", args[0]);
+	if (element == NULL) {
+		return NULL;
+	}
+	Function* compare = args.size() > 1 ? dyn_cast<Function>(args.back()) : NULL;
+	if (compare == NULL && args.size() > 1 && args.back()->getType()->isPointerTy()) {
+		ast_error("sort comparator must be a function or lambda");
+		return NULL;
+	}
+	size_t counted = args.size() - (compare ? 1 : 0);
+	if (counted > 2) {
+		ast_error("sort takes an array, a length and a comparator");
+		return NULL;
+	}
+	Value* length = arrayLength(context, "sort", args[0], counted > 1 ? args[1] : NULL);
+	if (length == NULL) {
+		return NULL;
+	}
+
+	if (compare == NULL) {
+		return callArrayKernel(context, "sort", args[0], Type::getVoidTy(TheContext), {args[0], length}) ? args[0] : NULL;
+	}
+	FunctionType* type = compare->getFunctionType();
+	if (!type->getReturnType()->isIntegerTy(1) || type->getNumParams() != 2
+		|| type->getParamType(0) != element || type->getParamType(1) != element) {
+		ast_error("sort comparator must take two " + getTypeString(element) + " and return bool");
+		return NULL;
+	}
+	Builder.CreateCall(comparatorSort(context, compare, element), {args[0], length});
+	return args[0];
+}
+
+/* The key and value types of a map[K]V type, NULL for any other type */
+static const MapType* mapOf(Type* type) {
+	auto found = mapTypes.find(type);
+	return found == mapTypes.end() ? NULL : &found->second;
+}
+
+static std::string mapName(Value* map) {
+	return map->getType()->getPointerElementType()->getStructName().str();
+}
+
+static bool checkMap(const std::string& name, Value* value) {
+	if (mapOf(value->getType()) == NULL) {
+		ast_error(name + " needs a map, not " + getTypeString(value));
+		return false;
+	}
+	return true;
+}
+
+/* Map and task slots are 64 bits: integers widen by their sign, floats and strings keep their bits */
+static Value* slotEncode(Value* value, bool isUnsigned) {
+	Type* type = value->getType();
+	Type* i64 = Type::getInt64Ty(TheContext);
+	if (type->isIntegerTy()) {
+		return Builder.CreateIntCast(value, i64, !isUnsigned && !type->isIntegerTy(1));
+	} else if (type->isFloatTy()) {
+		return Builder.CreateZExt(Builder.CreateBitCast(value, Type::getInt32Ty(TheContext)), i64);
+	} else if (type->isDoubleTy()) {
+		return Builder.CreateBitCast(value, i64);
+	}
+	return Builder.CreatePtrToInt(value, i64);
+}
+
+static Value* slotDecode(Value* bits, Type* type) {
+	if (type->isIntegerTy()) {
+		return Builder.CreateTrunc(bits, type);
+	} else if (type->isFloatTy()) {
+		return Builder.CreateBitCast(Builder.CreateTrunc(bits, Type::getInt32Ty(TheContext)), type);
+	} else if (type->isDoubleTy()) {
+		return Builder.CreateBitCast(bits, type);
+	}
+	return Builder.CreateIntToPtr(bits, type);
+}
+
+/* Call __coo_map_<op> of the runtime (src/runtime/map.c), the table goes in as an i8* */
+static Value* callMapRuntime(CodeGenContext& context, const std::string& op, Type* result, std::vector<Value*> args) {
+	args[0] = Builder.CreateBitCast(args[0], Type::getInt8PtrTy(TheContext));
+	std::vector<Type*> params;
+	for (Value* arg : args) {
+		params.push_back(arg->getType());
+	}
+	FunctionType* ftype = FunctionType::get(result, params, false);
+	Constant* function = context.module->getOrInsertFunction("__coo_map_" + op, ftype);
+	return Builder.CreateCall(function, args);
+}
+
+/* A new empty table for a map of type, string keys are hashed by content */
+static Value* mapNew(CodeGenContext& context, Type* type) {
+	FunctionType* ftype = FunctionType::get(Type::getInt8PtrTy(TheContext), {Type::getInt32Ty(TheContext)}, false);
+	Constant* function = context.module->getOrInsertFunction("__coo_map_new", ftype);
+	Value* table = Builder.CreateCall(function, {Builder.getInt32(mapOf(type)->key->isPointerTy())});
+	return Builder.CreateBitCast(table, type);
+}
+
+/* key as a table slot, NULL when it is not of the map's key type */
+static Value* mapKey(CodeGenContext& context, Value* map, Value* key) {
+	const MapType* type = mapOf(map->getType());
+	key = adaptLiteral(context, key, type->key, type->keyUnsigned);
+	if (key->getType() != type->key) {
+		ast_error(mapName(map) + " keys cannot be " + getTypeString(key));
+		return NULL;
+	}
+	return slotEncode(key, type->keyUnsigned);
+}
+
+/* m[k] and get(m, k): the value of k, zero when k is not in m */
+static Value* mapGet(CodeGenContext& context, Value* map, Value* key) {
+	Value* slot = mapKey(context, map, key);
+	if (slot == NULL) {
+		return NULL;
+	}
+	const MapType* type = mapOf(map->getType());
+	Value* value = slotDecode(callMapRuntime(context, "get", Type::getInt64Ty(TheContext), {map, slot}), type->value);
+	context.setUnsigned(value, type->valueUnsigned);
+	return value;
+}
+
+/* m[k] = v and put(m, k, v) */
+static Value* mapPut(CodeGenContext& context, Value* map, Value* key, Value* value) {
+	Value* slot = mapKey(context, map, key);
+	if (slot == NULL) {
+		return NULL;
+	}
+	const MapType* type = mapOf(map->getType());
+	value = adaptLiteral(context, value, type->value, type->valueUnsigned);
+	if (value->getType() != type->value) {
+		ast_error("cannot put " + getTypeString(value) + " into " + mapName(map) + " !");
+		return NULL;
+	}
+	return callMapRuntime(context, "put", Type::getVoidTy(TheContext), {map, slot, slotEncode(value, type->valueUnsigned)});
+}
+
+static Value* mapGetBuiltin(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("get", args, 2, 2) || !checkMap("get", args[0])) {
+		return NULL;
+	}
+	return mapGet(context, args[0], args[1]);
+}
+
+static Value* mapPutBuiltin(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("put", args, 3, 3) || !checkMap("put", args[0])) {
+		return NULL;
+	}
+	return mapPut(context, args[0], args[1], args[2]);
+}
+
+/* has(m, k): whether k is in m */
+static Value* mapHas(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("has", args, 2, 2) || !checkMap("has", args[0])) {
+		return NULL;
+	}
+	Value* slot = mapKey(context, args[0], args[1]);
+	if (slot == NULL) {
+		return NULL;
+	}
+	Value* found = callMapRuntime(context, "has", Type::getInt32Ty(TheContext), {args[0], slot});
+	return Builder.CreateICmpNE(found, Builder.getInt32(0));
+}
+
+/* delete(m, k): remove k from m, false when it was not there */
+static Value* mapDelete(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("delete", args, 2, 2) || !checkMap("delete", args[0])) {
+		return NULL;
+	}
+	Value* slot = mapKey(context, args[0], args[1]);
+	if (slot == NULL) {
+		return NULL;
+	}
+	Value* removed = callMapRuntime(context, "delete", Type::getInt32Ty(TheContext), {args[0], slot});
+	return Builder.CreateICmpNE(removed, Builder.getInt32(0));
+}
+
+/* reserve(m, n): size the table for n keys up front, saving the rehashes of growing to it */
+static Value* mapReserve(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("reserve", args, 2, 2) || !checkMap("reserve", args[0])) {
+		return NULL;
+	}
+	if (!args[1]->getType()->isIntegerTy() || args[1]->getType()->isIntegerTy(1)) {
+		ast_error("reserve needs a key count, not " + getTypeString(args[1]));
+		return NULL;
+	}
+	Value* count = convertValue(context, args[1], Type::getInt64Ty(TheContext), false);
+	return callMapRuntime(context, "reserve", Type::getVoidTy(TheContext), {args[0], count});
+}
+
+/* Slot argument of the iteration builtins as the long the runtime takes */
+static Value* mapSlot(CodeGenContext& context, const std::string& name, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs(name, args, 2, 2) || !checkMap(name, args[0])) {
+		return NULL;
+	}
+	if (!args[1]->getType()->isIntegerTy() || args[1]->getType()->isIntegerTy(1)) {
+		ast_error(name + " needs a slot from next, not " + getTypeString(args[1]));
+		return NULL;
+	}
+	return Builder.CreateIntCast(args[1], Type::getInt64Ty(TheContext), true);
+}
+
+/**
+ * next(m, s): the slot of the key after slot s, next(m, -1) the first one
+ * and -1 after the last. key(m, s) and value(m, s) read the slot:
+ *
+ *     for var s = next(m, -1); s >= 0; s = next(m, s) { ... key(m, s) ... }
+ *
+ * The order is the table's, adding keys during the loop may reorder it.
+ */
+static Value* mapNext(CodeGenContext& context, std::vector<Value*>& args) {
+	Value* slot = mapSlot(context, "next", args);
+	if (slot == NULL) {
+		return NULL;
+	}
+	Value* next = callMapRuntime(context, "next", Type::getInt64Ty(TheContext), {args[0], slot});
+	return Builder.CreateTrunc(next, Type::getInt32Ty(TheContext));
+}
+
+static Value* mapSlotKey(CodeGenContext& context, std::vector<Value*>& args) {
+	Value* slot = mapSlot(context, "key", args);
+	if (slot == NULL) {
+		return NULL;
+	}
+	const MapType* type = mapOf(args[0]->getType());
+	Value* key = slotDecode(callMapRuntime(context, "key", Type::getInt64Ty(TheContext), {args[0], slot}), type->key);
+	context.setUnsigned(key, type->keyUnsigned);
+	return key;
+}
+
+static Value* mapSlotValue(CodeGenContext& context, std::vector<Value*>& args) {
+	Value* slot = mapSlot(context, "value", args);
+	if (slot == NULL) {
+		return NULL;
+	}
+	const MapType* type = mapOf(args[0]->getType());
+	Value* value = slotDecode(callMapRuntime(context, "value", Type::getInt64Ty(TheContext), {args[0], slot}), type->value);
+	context.setUnsigned(value, type->valueUnsigned);
+	return value;
+}
+
+/* Declare the runtime function name for the argument types and call it */
+static Value* callRuntime(CodeGenContext& context, const std::string& name, Type* result, std::vector<Value*> args) {
+	std::vector<Type*> params;
+	for (Value* arg : args) {
+		params.push_back(arg->getType());
+	}
+	FunctionType* ftype = FunctionType::get(result, params, false);
+	Constant* function = context.module->getOrInsertFunction(name, ftype);
+	return Builder.CreateCall(function, args);
+}
+
+/* Length of a string, the i64 right before its characters */
+static Value* stringLength(Value* string) {
+	Value* header = Builder.CreateBitCast(string, Type::getInt64PtrTy(TheContext));
+	return Builder.CreateLoad(Builder.CreateInBoundsGEP(header, Builder.getInt64(-1)));
+}
+
+/* A string: i8* that is not a byte array, those have no length header */
+static bool isString(CodeGenContext& context, Value* value) {
+	return value->getType() == Type::getInt8PtrTy(TheContext) && !context.isByteArray(value);
+}
+
+/* Characters and length of a string or a view, false for anything else */
+static bool textParts(CodeGenContext& context, Value* text, Value*& chars, Value*& length) {
+	if (isString(context, text)) {
+		chars = text;
+		length = stringLength(text);
+		return true;
+	}
+	if (text->getType() == stringViewType()) {
+		chars = Builder.CreateExtractValue(text, 0);
+		length = Builder.CreateExtractValue(text, 1);
+		return true;
+	}
+	return false;
+}
+
+static bool isText(CodeGenContext& context, Value* value) {
+	return isString(context, value) || value->getType() == stringViewType();
+}
+
+/**
+ * a + b for strings and views, the result is a new string. A left side
+ * that is itself a fresh concatenation has no other user, so b is appended
+ * to it in place and a + b + c + d grows one buffer instead of copying the
+ * whole prefix at every +.
+ */
+static Value* stringConcat(CodeGenContext& context, Value* left, Value* right) {
+	Value *leftChars, *leftLength, *rightChars, *rightLength;
+	if (!isText(context, left) || !textParts(context, right, rightChars, rightLength)) {
+		ast_error("cannot add " + getTypeString(right) + " to " + getTypeString(left) + " !");
+		return NULL;
+	}
+	Type* string = Type::getInt8PtrTy(TheContext);
+	CallInst* call = dyn_cast<CallInst>(left);
+	Function* callee = call ? call->getCalledFunction() : NULL;
+	if (callee && (callee->getName() == "__coo_str_concat" || callee->getName() == "__coo_str_append")) {
+		return callRuntime(context, "__coo_str_append", string, {left, rightChars, rightLength});
+	}
+	textParts(context, left, leftChars, leftLength);
+	return callRuntime(context, "__coo_str_concat", string, {leftChars, leftLength, rightChars, rightLength});
+}
+
+/* Index argument of the string builtins as a long */
+static Value* textIndex(const std::string& name, Value* index) {
+	if (!index->getType()->isIntegerTy() || index->getType()->isIntegerTy(1)) {
+		ast_error(name + " needs an integer position, not " + getTypeString(index));
+		return NULL;
+	}
+	return Builder.CreateIntCast(index, Type::getInt64Ty(TheContext), true);
+}
+
+/* min(max(value, low), high) for signed longs */
+static Value* clampIndex(Value* value, Value* low, Value* high) {
+	value = Builder.CreateSelect(Builder.CreateICmpSLT(value, low), low, value);
+	return Builder.CreateSelect(Builder.CreateICmpSGT(value, high), high, value);
+}
+
+/* slice(s, start[, end]): a view of s from start up to end (its length by default), nothing is copied */
+static Value* stringSlice(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("slice", args, 2, 3)) {
+		return NULL;
+	}
+	Value *chars, *length;
+	if (!textParts(context, args[0], chars, length)) {
+		ast_error("slice needs a string or a view, not " + getTypeString(args[0]));
+		return NULL;
+	}
+	Value* start = textIndex("slice", args[1]);
+	Value* end = args.size() > 2 ? textIndex("slice", args[2]) : length;
+	if (start == NULL || end == NULL) {
+		return NULL;
+	}
+	// positions out of range are clamped, like the bounds of a for loop
+	start = clampIndex(start, Builder.getInt64(0), length);
+	end = clampIndex(end, start, length);
+
+	Value* view = UndefValue::get(stringViewType());
+	view = Builder.CreateInsertValue(view, Builder.CreateInBoundsGEP(chars, start), 0);
+	return Builder.CreateInsertValue(view, Builder.CreateSub(end, start), 1);
+}
+
+/* string(x): a string of its own for a view or the contents of a strbuf, a string stays itself */
+static Value* stringOf(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("string", args, 1, 1)) {
+		return NULL;
+	}
+	Type* string = Type::getInt8PtrTy(TheContext);
+	if (isString(context, args[0])) {
+		return args[0];
+	}
+	if (args[0]->getType() == stringBuilderType()) {
+		return callRuntime(context, "__coo_strbuf_string", string, {args[0]});
+	}
+	Value *chars, *length;
+	if (!textParts(context, args[0], chars, length)) {
+		ast_error("string needs a view or a strbuf, not " + getTypeString(args[0]));
+		return NULL;
+	}
+	return callRuntime(context, "__coo_str_copy", string, {chars, length});
+}
+
+/* append(b, x) adds a string, view, number or bool to the strbuf b, amortized O(1) per character */
+static Value* stringAppend(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("append", args, 2, 2)) {
+		return NULL;
+	}
+	Value* buffer = args[0];
+	Value* value = args[1];
+	Type* type = value->getType();
+	Type* none = Type::getVoidTy(TheContext);
+	if (buffer->getType() != stringBuilderType()) {
+		ast_error("append needs a strbuf, not " + getTypeString(buffer));
+		return NULL;
+	}
+
+	Value *chars, *length;
+	if (textParts(context, value, chars, length)) {
+		callRuntime(context, "__coo_strbuf_append", none, {buffer, chars, length});
+	} else if (type->isIntegerTy(1)) {
+		Value* text = Builder.CreateSelect(value, NString("true").codeGen(context), NString("false").codeGen(context));
+		callRuntime(context, "__coo_strbuf_append", none, {buffer, text, stringLength(text)});
+	} else if (type->isIntegerTy()) {
+		bool isUnsigned = context.isUnsigned(value);
+		Value* number = Builder.CreateIntCast(value, Type::getInt64Ty(TheContext), !isUnsigned);
+		callRuntime(context, "__coo_strbuf_append_int", none, {buffer, number, Builder.getInt32(isUnsigned)});
+	} else if (type->isFloatingPointTy()) {
+		Value* number = Builder.CreateFPCast(value, Type::getDoubleTy(TheContext));
+		callRuntime(context, "__coo_strbuf_append_float", none, {buffer, number});
+	} else {
+		ast_error("cannot append " + getTypeString(value) + " to a strbuf");
+		return NULL;
+	}
+	return buffer;
+}
+
+static bool checkFile(const std::string& name, Value* value) {
+	if (value->getType() != fileType()) {
+		ast_error(name + " needs a file, not " + getTypeString(value));
+		return false;
+	}
+	return true;
+}
+
+/* open(path): a file to read, "-" is the standard input */
+static Value* fileOpen(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("open", args, 1, 1)) {
+		return NULL;
+	}
+	if (args[0]->getType() != Type::getInt8PtrTy(TheContext)) {
+		ast_error("open needs a path, not " + getTypeString(args[0]));
+		return NULL;
+	}
+	return callRuntime(context, "__coo_file_open", fileType(), {args[0]});
+}
+
+/* A view of what __coo_file_<op> hands out through a pointer in the entry block */
+static Value* fileView(CodeGenContext& context, const std::string& op, std::vector<Value*> args) {
+	Type* chars = Type::getInt8PtrTy(TheContext);
+	Value* start = new AllocaInst(chars, 0, "", (Instruction *)context.currentBlock()->returnValue);
+	args.push_back(start);
+	Value* length = callRuntime(context, "__coo_file_" + op, Type::getInt64Ty(TheContext), args);
+	Value* view = UndefValue::get(stringViewType());
+	view = Builder.CreateInsertValue(view, Builder.CreateLoad(start), 0);
+	return Builder.CreateInsertValue(view, length, 1);
+}
+
+/* line(f): the next line as a view into the file, without its line break */
+static Value* fileLine(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("line", args, 1, 1) || !checkFile("line", args[0])) {
+		return NULL;
+	}
+	return fileView(context, "line", {args[0]});
+}
+
+/* record(f, n): the next n bytes as a view, fewer at the end */
+static Value* fileRecord(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("record", args, 2, 2) || !checkFile("record", args[0])) {
+		return NULL;
+	}
+	if (!args[1]->getType()->isIntegerTy() || args[1]->getType()->isIntegerTy(1)) {
+		ast_error("record needs a size in bytes, not " + getTypeString(args[1]));
+		return NULL;
+	}
+	Value* size = Builder.CreateIntCast(args[1], Type::getInt64Ty(TheContext), !context.isUnsigned(args[1]));
+	return fileView(context, "record", {args[0], size});
+}
+
+/* eof(f): whether the last line, record or number ran past the end */
+static Value* fileEof(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("eof", args, 1, 1) || !checkFile("eof", args[0])) {
+		return NULL;
+	}
+	Value* eof = callRuntime(context, "__coo_file_eof", Type::getInt32Ty(TheContext), {args[0]});
+	return Builder.CreateICmpNE(eof, Builder.getInt32(0));
+}
+
+/* read_int(f): the next whitespace separated integer of the file */
+static Value* fileReadInt(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("read_int", args, 1, 1) || !checkFile("read_int", args[0])) {
+		return NULL;
+	}
+	return callRuntime(context, "__coo_file_read_int", Type::getInt64Ty(TheContext), {args[0]});
+}
+
+static Value* fileReadFloat(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("read_float", args, 1, 1) || !checkFile("read_float", args[0])) {
+		return NULL;
+	}
+	return callRuntime(context, "__coo_file_read_float", Type::getDoubleTy(TheContext), {args[0]});
+}
 
-	/* Create top level interpreter function to call as entry*/
-	vector<Type*> argTypes;
-	FunctionType *ftype = FunctionType::get(Type::getInt32Ty(TheContext), makeArrayRef(argTypes), false);
-	mainFunction = Function::Create(ftype, GlobalValue::ExternalLinkage, "main", module);
-	BasicBlock *bblock = BasicBlock::Create(TheContext, "entry", mainFunction, 0);
-	BasicBlock *retblock = BasicBlock::Create(TheContext, "retBlock", mainFunction, 0);
+/* parse_int(v) and parse_float(v): the number at the start of a view or string */
+static Value* textParse(CodeGenContext& context, const std::string& name, Type* result, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs(name, args, 1, 1)) {
+		return NULL;
+	}
+	Value *chars, *length;
+	if (!textParts(context, args[0], chars, length)) {
+		ast_error(name + " needs a string or a view, not " + getTypeString(args[0]));
+		return NULL;
+	}
+	return callRuntime(context, "__coo_" + name, result, {chars, length});
+}
 
-	/* Push a new variable/block context */
-	Builder.SetInsertPoint(bblock);
-	pushBlock(bblock);
-	currentBlock()->returnBlock = retblock;
-	currentBlock()->returnValue = Builder.CreateAlloca(Type::getInt32Ty(TheContext), 0, NULL, "");
-	root.codeGen(*this); /* Emit bytecode for toplevel block*/
+static Value* parseInt(CodeGenContext& context, std::vector<Value*>& args) {
+	return textParse(context, "parse_int", Type::getInt64Ty(TheContext), args);
+}
 
-	// ret part
-	Builder.CreateBr(retblock);
-	Builder.SetInsertPoint(retblock);
-	Builder.CreateRet(ConstantInt::get(Type::getInt32Ty(TheContext), 0, true));
-	popBlock();
+static Value* parseFloat(CodeGenContext& context, std::vector<Value*>& args) {
+	return textParse(context, "parse_float", Type::getDoubleTy(TheContext), args);
+}
 
-	cout << "Code is generated.\n";
-	/*Print the bytecode*/
-	// legacy::PassManager pm;
-	// pm.add(createPrintModulePass(outs()));
-	// pm.run(*module);
+static const ChannelType* channelOf(Type* type) {
+	auto found = channelTypes.find(type);
+	return found == channelTypes.end() ? NULL : &found->second;
 }
 
-/* Executes program main function*/
-GenericValue CodeGenContext::runCode() {
-	cout << "Running code...\n";
-	InitializeNativeTarget();
-	InitializeNativeTargetAsmPrinter();
-	InitializeNativeTargetAsmParser();
-	ExecutionEngine *ee = EngineBuilder(unique_ptr<Module>(module)).create();
+static bool checkChannel(const std::string& name, Value* value) {
+	if (channelOf(value->getType()) == NULL) {
+		ast_error(name + " needs a channel, not " + getTypeString(value));
+		return false;
+	}
+	return true;
+}
 
-	vector<GenericValue> noargs;
-	GenericValue v = ee->runFunction(mainFunction, noargs);
-  	// ee->freeMachineCodeForFunction(mainFunction);
-  	delete ee;
-  	llvm_shutdown();
-	cout << "Code was run.\n";
-	return v;
+/* send(c, v): false when c is closed, waits while c is full */
+static Value* channelSend(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("send", args, 2, 2) || !checkChannel("send", args[0])) {
+		return NULL;
+	}
+	const ChannelType* type = channelOf(args[0]->getType());
+	Value* value = adaptLiteral(context, args[1], type->element, type->elementUnsigned);
+	if (value->getType() != type->element) {
+		ast_error("cannot send " + getTypeString(value) + " on a " + args[0]->getType()->getPointerElementType()->getStructName().str());
+		return NULL;
+	}
+	Value* channel = Builder.CreateBitCast(args[0], Type::getInt8PtrTy(TheContext));
+	Value* sent = callRuntime(context, "__coo_chan_send", Type::getInt32Ty(TheContext), {channel, slotEncode(value, type->elementUnsigned)});
+	return Builder.CreateICmpNE(sent, Builder.getInt32(0));
 }
 
-/* Returns a LLVM type based on the identifier */
-static Type *typeOf(NIdentifier type) {
-	if (type.name.compare("int") == 0) {
-		return Type::getInt32Ty(TheContext);
-	} else if (type.name.compare("[]int") == 0) {
-		return Type::getInt32PtrTy(TheContext);
-	} else if (type.name.compare("long") == 0) {
-		return Type::getInt64Ty(TheContext);
-	} else if (type.name.compare("[]long") == 0) {
-		return Type::getInt64PtrTy(TheContext);
-	} else if (type.name.compare("float") == 0) {
-		return Type::getDoubleTy(TheContext);
-	} else if (type.name.compare("[]float") == 0) {
-		return Type::getDoublePtrTy(TheContext);
-	} else if (type.name.compare("string") == 0) {
-		return Type::getInt8PtrTy(TheContext);
-	} else if (type.name.compare("[]string") == 0) {
-		return Type::getInt8PtrTy(TheContext)->getPointerTo();
-	} else if (type.name.compare("bool") == 0) {
-		return Type::getInt1Ty(TheContext);
-	} else if (type.name.compare("[]bool") == 0) {
-		return Type::getInt1PtrTy(TheContext);
-	} else if (type.name.compare("void") == 0) {
-		return Type::getVoidTy(TheContext);
+/**
+ * Receive through __coo_chan_<op> into a slot of the entry block. With an
+ * array out the value goes to out[0] and the result is whether there was
+ * one, without it the value is the result (zero once c is closed and empty).
+ */
+static Value* channelReceive(CodeGenContext& context, const std::string& name, const std::string& op, std::vector<Value*>& args, bool needsOut) {
+	if (!checkBuiltinArgs(name, args, needsOut ? 2 : 1, 2) || !checkChannel(name, args[0])) {
+		return NULL;
+	}
+	const ChannelType* type = channelOf(args[0]->getType());
+	Value* out = args.size() > 1 ? args[1] : NULL;
+	if (out && out->getType() != type->element->getPointerTo()) {
+		ast_error(name + " stores into an array of the channel's elements, not " + getTypeString(out));
+		return NULL;
 	}
+	Value* slot = new AllocaInst(Type::getInt64Ty(TheContext), 0, "", (Instruction *)context.currentBlock()->returnValue);
+	Builder.CreateStore(Builder.getInt64(0), slot);
+	Value* channel = Builder.CreateBitCast(args[0], Type::getInt8PtrTy(TheContext));
+	Value* received = callRuntime(context, "__coo_chan_" + op, Type::getInt32Ty(TheContext), {channel, slot});
+	Value* value = slotDecode(Builder.CreateLoad(slot), type->element);
+	context.setUnsigned(value, type->elementUnsigned);
+	if (out == NULL) {
+		return value;
+	}
+	Builder.CreateStore(value, out);
+	return Builder.CreateICmpNE(received, Builder.getInt32(0));
+}
 
-	return Type::getVoidTy(TheContext);
+/* recv(c) or recv(c, out), waits while c is empty and open */
+static Value* channelRecv(CodeGenContext& context, std::vector<Value*>& args) {
+	return channelReceive(context, "recv", "recv", args, false);
 }
 
-static Type *typeOf(NIdentifier type, NIdentifier funcType, IdentifierList funcParams) {
-	if (type.name.compare("func") == 0) {
-		std::vector<Type*> argTypes;
-		for (auto it = funcParams.begin(); it != funcParams.end(); it++) {
-			cout << "function parameter argument: " << (**it).name << endl;
-			/* fix: recursion function type (need a scalable type system) */
-			argTypes.push_back(typeOf(**it));
-		}
-		FunctionType *ftype = FunctionType::get(typeOf(funcType), makeArrayRef(argTypes), false);
-		return ftype->getPointerTo();
+/* try_recv(c, out): whether a value was there, never waits */
+static Value* channelTryRecv(CodeGenContext& context, std::vector<Value*>& args) {
+	return channelReceive(context, "try_recv", "try_recv", args, true);
+}
+
+/* close(c) closes a channel for senders, close(f) unmaps or frees a file and its views */
+static Value* valueClose(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("close", args, 1, 1)) {
+		return NULL;
+	}
+	if (args[0]->getType() == fileType()) {
+		return callRuntime(context, "__coo_file_close", Type::getVoidTy(TheContext), {args[0]});
 	}
+	if (!checkChannel("close", args[0])) {
+		return NULL;
+	}
+	Value* channel = Builder.CreateBitCast(args[0], Type::getInt8PtrTy(TheContext));
+	return callRuntime(context, "__coo_chan_close", Type::getVoidTy(TheContext), {channel});
+}
 
-	if (type.name.compare("int") == 0) {
-		return Type::getInt32Ty(TheContext);
-	} else if (type.name.compare("[]int") == 0) {
-		return Type::getInt32PtrTy(TheContext);
-	} else if (type.name.compare("long") == 0) {
-		return Type::getInt64Ty(TheContext);
-	} else if (type.name.compare("[]long") == 0) {
-		return Type::getInt64PtrTy(TheContext);
-	} else if (type.name.compare("float") == 0) {
-		return Type::getDoubleTy(TheContext);
-	} else if (type.name.compare("[]float") == 0) {
-		return Type::getDoublePtrTy(TheContext);
-	} else if (type.name.compare("string") == 0) {
-		return Type::getInt8PtrTy(TheContext);
-	} else if (type.name.compare("[]string") == 0) {
-		return Type::getInt8PtrTy(TheContext)->getPointerTo();
-	} else if (type.name.compare("bool") == 0) {
-		return Type::getInt1Ty(TheContext);
-	} else if (type.name.compare("[]bool") == 0) {
-		return Type::getInt1PtrTy(TheContext);
-	} else if (type.name.compare("void") == 0) {
-		return Type::getVoidTy(TheContext);
+/* join(): wait until every spawned function has returned */
+static Value* spawnJoin(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("join", args, 0, 0)) {
+		return NULL;
 	}
+	return callRuntime(context, "__coo_join", Type::getVoidTy(TheContext), {});
+}
 
-	return Type::getVoidTy(TheContext);
+/* len(x): characters of a string, view or strbuf, keys of a map, values waiting in a channel */
+static Value* valueLength(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("len", args, 1, 1)) {
+		return NULL;
+	}
+	Value *chars, *length;
+	if (mapOf(args[0]->getType())) {
+		length = callMapRuntime(context, "len", Type::getInt64Ty(TheContext), {args[0]});
+	} else if (args[0]->getType() == stringBuilderType()) {
+		length = callRuntime(context, "__coo_strbuf_len", Type::getInt64Ty(TheContext), {args[0]});
+	} else if (channelOf(args[0]->getType())) {
+		Value* channel = Builder.CreateBitCast(args[0], Type::getInt8PtrTy(TheContext));
+		length = callRuntime(context, "__coo_chan_len", Type::getInt64Ty(TheContext), {channel});
+	} else if (!textParts(context, args[0], chars, length)) {
+		ast_error("len needs a string, view, strbuf, map or channel, not " + getTypeString(args[0]));
+		return NULL;
+	}
+	return Builder.CreateTrunc(length, Type::getInt32Ty(TheContext));
 }
 
-static Value* getArrayIndex(Value* array,  Value* index) {
-	std::vector<Value*> indices;
+/* Maps, string builders and channels can be used right after their declaration, views start out empty */
+static Value* initialValue(CodeGenContext& context, Type* type, int capacity = 0) {
+	if (mapOf(type)) {
+		return mapNew(context, type);
+	} else if (channelOf(type)) {
+		Value* slots = Builder.getInt64(capacity > 0 ? capacity : 64);
+		return Builder.CreateBitCast(callRuntime(context, "__coo_chan_new", Type::getInt8PtrTy(TheContext), {slots}), type);
+	} else if (type == stringBuilderType()) {
+		return callRuntime(context, "__coo_strbuf_new", type, {});
+	} else if (type == stringViewType()) {
+		return Constant::getNullValue(type);
+	}
+	return NULL;
+}
 
-	cout << "array type is: " << getTypeString(array) << endl;
-	if (ends_with(getTypeString(array), "**")) {
-		array = Builder.CreateLoad(array);
-	} else {
-		indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), 0, false));
+static const TaskType* taskOf(Type* type) {
+	auto found = taskTypes.find(type);
+	return found == taskTypes.end() ? NULL : &found->second;
+}
+
+static Function* coroutineIntrinsic(CodeGenContext& context, Intrinsic::ID id, ArrayRef<Type*> types = None) {
+	return Intrinsic::getDeclaration(context.module, id, types);
+}
+
+/**
+ * Start of an async function, which is a switched-resume coroutine: its frame
+ * comes from malloc unless CoroElide can replace it with an alloca of the
+ * caller, and its task is created before the body runs up to the first await.
+ */
+static void coroutineBegin(CodeGenContext& context, Function* function) {
+	CodeGenBlock* block = context.currentBlock();
+	Type* bytes = Type::getInt8PtrTy(TheContext);
+	Value* none = ConstantPointerNull::get(Type::getInt8PtrTy(TheContext));
+	Value* id = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_id), {Builder.getInt32(0), none, none, none});
+
+	BasicBlock* entry = Builder.GetInsertBlock();
+	BasicBlock* allocate = BasicBlock::Create(TheContext, "coro.alloc", function);
+	BasicBlock* begin = BasicBlock::Create(TheContext, "coro.begin", function);
+	Builder.CreateCondBr(Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_alloc), {id}), allocate, begin);
+	Builder.SetInsertPoint(allocate);
+	Value* size = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_size, {Type::getInt64Ty(TheContext)}));
+	Value* memory = callRuntime(context, "malloc", bytes, {size});
+	Builder.CreateBr(begin);
+
+	Builder.SetInsertPoint(begin);
+	PHINode* frame = Builder.CreatePHI(bytes, 2);
+	frame->addIncoming(none, entry);
+	frame->addIncoming(memory, allocate);
+	block->coroutineId = id;
+	block->coroutineHandle = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_begin), {id, frame});
+	block->task = callRuntime(context, "__coo_task_new", bytes, {block->coroutineHandle});
+	block->coroutineCleanup = BasicBlock::Create(TheContext, "coro.cleanup", function);
+	block->coroutineSuspend = BasicBlock::Create(TheContext, "coro.suspend", function);
+}
+
+/**
+ * End of an async function: hand result to the task and suspend for the last
+ * time, the frame stays until the awaiting side took the result and destroys
+ * it (cleanup). The ramp returns the task from the suspend block; the destroy
+ * path ends on its own, the task would be read from an already freed frame.
+ */
+static void coroutineEnd(CodeGenContext& context, Type* taskType, Value* result, bool isUnsigned) {
+	CodeGenBlock* block = context.currentBlock();
+	Function* function = Builder.GetInsertBlock()->getParent();
+	Value* bits = result ? slotEncode(result, isUnsigned) : Builder.getInt64(0);
+	callRuntime(context, "__coo_task_return", Type::getVoidTy(TheContext), {block->task, bits});
+
+	BasicBlock* resumed = BasicBlock::Create(TheContext, "coro.final", function);
+	Value* suspend = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_suspend),
+		{ConstantTokenNone::get(TheContext), Builder.getTrue()});
+	SwitchInst* next = Builder.CreateSwitch(suspend, block->coroutineSuspend, 2);
+	next->addCase(Builder.getInt8(0), resumed);
+	next->addCase(Builder.getInt8(1), block->coroutineCleanup);
+	Builder.SetInsertPoint(resumed);
+	Builder.CreateUnreachable();
+
+	Builder.SetInsertPoint(block->coroutineCleanup);
+	Value* frame = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_free), {block->coroutineId, block->coroutineHandle});
+	BasicBlock* release = BasicBlock::Create(TheContext, "coro.free", function);
+	BasicBlock* destroyed = BasicBlock::Create(TheContext, "coro.destroyed", function);
+	Builder.CreateCondBr(Builder.CreateIsNotNull(frame), release, destroyed);
+	Builder.SetInsertPoint(release);
+	callRuntime(context, "free", Type::getVoidTy(TheContext), {frame});
+	Builder.CreateBr(destroyed);
+	Builder.SetInsertPoint(destroyed);
+	Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_end), {block->coroutineHandle, Builder.getFalse()});
+	Builder.CreateRet(ConstantPointerNull::get(cast<PointerType>(taskType)));
+
+	Builder.SetInsertPoint(block->coroutineSuspend);
+	Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_end), {block->coroutineHandle, Builder.getFalse()});
+	Builder.CreateRet(Builder.CreateBitCast(block->task, taskType));
+}
+
+/* sleep(ms): a task[int] done after ms milliseconds */
+static Value* asyncSleep(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("sleep", args, 1, 1)) {
+		return NULL;
 	}
-	indices.push_back(index);
+	Value* ms = adaptLiteral(context, args[0], Type::getInt64Ty(TheContext), false);
+	if (!ms->getType()->isIntegerTy()) {
+		ast_error("sleep needs milliseconds, not " + getTypeString(ms));
+		return NULL;
+	}
+	ms = Builder.CreateIntCast(ms, Type::getInt64Ty(TheContext), !context.isUnsigned(ms));
+	Type* type = taskTypeOf("int", Type::getInt32Ty(TheContext));
+	return Builder.CreateBitCast(callRuntime(context, "__coo_async_sleep", Type::getInt8PtrTy(TheContext), {ms}), type);
+}
 
-	return Builder.CreateInBoundsGEP(array, makeArrayRef(indices), "");
+/* read(fd, buf, n): a task[long] with the bytes read into the array buf, -1 on errors */
+static Value* asyncRead(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("read", args, 3, 3)) {
+		return NULL;
+	}
+	Value* fd = adaptLiteral(context, args[0], Type::getInt32Ty(TheContext), false);
+	Value* length = adaptLiteral(context, args[2], Type::getInt64Ty(TheContext), false);
+	if (!fd->getType()->isIntegerTy() || !args[1]->getType()->isPointerTy() || !length->getType()->isIntegerTy()) {
+		ast_error("read needs a file descriptor, an array and a byte count");
+		return NULL;
+	}
+	fd = Builder.CreateIntCast(fd, Type::getInt32Ty(TheContext), true);
+	Value* buffer = Builder.CreateBitCast(args[1], Type::getInt8PtrTy(TheContext));
+	length = Builder.CreateIntCast(length, Type::getInt64Ty(TheContext), !context.isUnsigned(length));
+	Type* type = taskTypeOf("long", Type::getInt64Ty(TheContext));
+	Value* task = callRuntime(context, "__coo_async_read", Type::getInt8PtrTy(TheContext), {fd, buffer, length});
+	return Builder.CreateBitCast(task, type);
+}
+
+/* run(): the event loop until every pending task that can finish has */
+static Value* asyncRun(CodeGenContext& context, std::vector<Value*>& args) {
+	if (!checkBuiltinArgs("run", args, 0, 0)) {
+		return NULL;
+	}
+	return callRuntime(context, "__coo_async_run", Type::getVoidTy(TheContext), {});
+}
+
+/**
+ * Worker side of spawn for functions of type ftype: unpack the callee and
+ * its arguments from the heap record, call it and free the record. There is
+ * one trampoline per function type, the callee travels in the record.
+ */
+static Function* spawnTrampoline(CodeGenContext& context, FunctionType* ftype, StructType* record) {
+	static std::map<FunctionType*, Function*> trampolines;
+	auto found = trampolines.find(ftype);
+	if (found != trampolines.end()) {
+		return found->second;
+	}
+	Type* bytes = Type::getInt8PtrTy(TheContext);
+	FunctionType* runType = FunctionType::get(Type::getVoidTy(TheContext), {bytes}, false);
+	Function* run = Function::Create(runType, GlobalValue::InternalLinkage, "__coo_spawn." + to_string(trampolines.size()), context.module);
+	IRBuilder<> b(BasicBlock::Create(TheContext, "entry", run));
+	Value* fields = b.CreateBitCast(&*run->arg_begin(), record->getPointerTo());
+	std::vector<Value*> args;
+	for (unsigned i = 1; i < record->getNumElements(); i++) {
+		args.push_back(b.CreateLoad(b.CreateStructGEP(record, fields, i)));
+	}
+	b.CreateCall(b.CreateLoad(b.CreateStructGEP(record, fields, 0)), args);
+	Constant* release = context.module->getOrInsertFunction("free", FunctionType::get(Type::getVoidTy(TheContext), {bytes}, false));
+	b.CreateCall(release, {&*run->arg_begin()});
+	b.CreateRetVoid();
+	trampolines[ftype] = run;
+	return run;
 }
 
+/* spawn callee(args): hand the call to the worker pool (src/runtime/channel.c) and go on */
+static Value* spawnCall(CodeGenContext& context, Value* callee, std::vector<Value*>& args) {
+	FunctionType* ftype = cast<FunctionType>(callee->getType()->getPointerElementType());
+	if (taskOf(ftype->getReturnType())) {
+		ast_error("spawn runs plain functions, async functions are awaited");
+		return NULL;
+	}
+	if (args.size() != ftype->getNumParams()) {
+		ast_error("spawn passes " + to_string(args.size()) + " arguments to a function of " + to_string(ftype->getNumParams()));
+		return NULL;
+	}
+	std::vector<Type*> fieldTypes = { callee->getType() };
+	for (Type* param : ftype->params()) {
+		fieldTypes.push_back(param);
+	}
+	StructType* record = StructType::get(TheContext, fieldTypes);
+	Function* run = spawnTrampoline(context, ftype, record);
+
+	Value* size = ConstantExpr::getSizeOf(record);
+	Value* memory = callRuntime(context, "malloc", Type::getInt8PtrTy(TheContext), {size});
+	Value* fields = Builder.CreateBitCast(memory, record->getPointerTo());
+	Builder.CreateStore(callee, Builder.CreateStructGEP(record, fields, 0));
+	for (unsigned i = 0; i < args.size(); i++) {
+		Builder.CreateStore(args[i], Builder.CreateStructGEP(record, fields, i + 1));
+	}
+	return callRuntime(context, "__coo_spawn", Type::getVoidTy(TheContext), {run, memory});
+}
+
+/* Functions the compiler generates inline, a program's own definition wins over them */
+typedef Value* (*BuiltinCodeGen)(CodeGenContext& context, std::vector<Value*>& args);
+static const std::map<std::string, BuiltinCodeGen> builtins = {
+	{ "extract", vectorExtract },
+	{ "insert", vectorInsert },
+	{ "shuffle", vectorShuffle },
+	{ "select", vectorSelect },
+	{ "hsum", vectorSum },
+	{ "hmin", vectorMin },
+	{ "hmax", vectorMax },
+	{ "vload", vectorLoad },
+	{ "vstore", vectorStore },
+	{ "fill", arrayFill },
+	{ "copy", arrayCopy },
+	{ "sum", arraySum },
+	{ "min", arrayMin },
+	{ "max", arrayMax },
+	{ "find", arrayFind },
+	{ "sort", arraySort },
+	{ "get", mapGetBuiltin },
+	{ "len", valueLength },
+	{ "has", mapHas },
+	{ "delete", mapDelete },
+	{ "reserve", mapReserve },
+	{ "next", mapNext },
+	{ "key", mapSlotKey },
+	{ "value", mapSlotValue },
+	{ "slice", stringSlice },
+	{ "string", stringOf },
+	{ "append", stringAppend },
+	{ "sleep", asyncSleep },
+	{ "read", asyncRead },
+	{ "run", asyncRun },
+	{ "send", channelSend },
+	{ "recv", channelRecv },
+	{ "try_recv", channelTryRecv },
+	{ "close", valueClose },
+	{ "join", spawnJoin },
+	{ "open", fileOpen },
+	{ "line", fileLine },
+	{ "record", fileRecord },
+	{ "eof", fileEof },
+	{ "read_int", fileReadInt },
+	{ "read_float", fileReadFloat },
+	{ "parse_int", parseInt },
+	{ "parse_float", parseFloat },
+};
+
 /* Code Generation */
 Value* NInteger::codeGen(CodeGenContext& context) {
 	cout << "Creating Integer: " << value << endl;
@@ -147,6 +2105,25 @@ Value* NLong::codeGen(CodeGenContext& context) {
 	return ConstantInt::get(Type::getInt64Ty(TheContext), value, true);
 }
 
+Value* NSizedInteger::codeGen(CodeGenContext& context) {
+	cout << "Creating " << type << ": " << value << endl;
+	Type* integer = numericTypeOf(type);
+	unsigned bits = integer->getIntegerBitWidth();
+	bool isUnsigned = isUnsignedType(type);
+	unsigned long long limit = isUnsigned ? ~0ULL >> (64 - bits) : ~0ULL >> (65 - bits);
+	if (value > limit) {
+		ast_error(to_string(value) + " does not fit in " + type);
+		return NULL;
+	}
+	Value* literal = ConstantInt::get(integer, value, false);
+	return isUnsigned ? unsignedValue(context, literal) : literal;
+}
+
+Value* NFloat::codeGen(CodeGenContext& context) {
+	cout << "Creating f32: " << value << endl;
+	return ConstantFP::get(Type::getFloatTy(TheContext), value);
+}
+
 Value* NDouble::codeGen(CodeGenContext& context) {
 	cout << "Creating Double: " << value << endl;
 	return ConstantFP::get(Type::getDoubleTy(TheContext), value);
@@ -157,9 +2134,18 @@ Value* NBoolean::codeGen(CodeGenContext& context) {
 	return ConstantInt::get(Type::getInt1Ty(TheContext), value, false);
 }
 
+/* A literal is laid out like a runtime string: { capacity 0, length, characters } */
 Value* NString::codeGen(CodeGenContext& context) {
 	cout << "Create String: " << value << endl;
-	return Builder.CreateGlobalStringPtr(StringRef(value.c_str()));
+	Type* i64 = Type::getInt64Ty(TheContext);
+	Constant* chars = ConstantDataArray::getString(TheContext, value);
+	StructType* type = StructType::get(i64, i64, chars->getType());
+	Constant* literal = ConstantStruct::get(type, ConstantInt::get(i64, 0), ConstantInt::get(i64, value.size()), chars);
+	GlobalVariable* global = new GlobalVariable(*context.module, type, true, GlobalValue::PrivateLinkage, literal, ".str");
+	global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+	global->setAlignment(8);
+	Constant* indices[] = { Builder.getInt32(0), Builder.getInt32(2), Builder.getInt32(0) };
+	return ConstantExpr::getInBoundsGetElementPtr(type, global, indices);
 }
 
 Value* NIdentifier::codeGen(CodeGenContext& context) {
@@ -169,6 +2155,21 @@ Value* NIdentifier::codeGen(CodeGenContext& context) {
 		context.currentBlock()->lazys.erase(name);
 	}
 
+	if (!field.empty()) {
+		Value* address = getFieldAddress(context, *this);
+		if (address == NULL) {
+			return NULL;
+		}
+		// a whole @soa column is used like an array, a pointer to its first element
+		if (!index && context.locals().find(name + "." + field) != context.locals().end()) {
+			context.setByteArray(address);
+			return address;
+		}
+		Value* load = Builder.CreateLoad(address, "");
+		context.setUnsigned(load, context.isUnsigned(address));
+		return load;
+	}
+
 	if (context.locals().find(name) == context.locals().end()) {
 		cerr << "undeclared variable " << name << endl;
 		return NULL;
@@ -182,17 +2183,59 @@ Value* NIdentifier::codeGen(CodeGenContext& context) {
 		return context.locals()[name];
 	}
 
+	if (index && mapOf(context.locals()[name]->getType()->getPointerElementType())) {
+		return mapGet(context, Builder.CreateLoad(context.locals()[name], ""), index->codeGen(context));
+	}
+
+	Value* result;
 	if (index) {
-		return Builder.CreateLoad(getArrayIndex(context.locals()[name], index->codeGen(context)), "");
+		result = Builder.CreateLoad(getArrayIndex(context.locals()[name], index->codeGen(context)), "");
 	} else if (((AllocaInst *)context.locals()[name])->isArrayAllocation()) {
-		return getArrayIndex(context.locals()[name], ConstantInt::get(Type::getInt64Ty(TheContext), 0, true));
+		result = getArrayIndex(context.locals()[name], ConstantInt::get(Type::getInt64Ty(TheContext), 0, true));
+		context.setByteArray(result);
+	} else {
+		result = Builder.CreateLoad(context.locals()[name], "");
+		context.setByteArray(result, context.isByteArray(context.locals()[name]));
 	}
-
-	return Builder.CreateLoad(context.locals()[name], "");
+	context.setUnsigned(result, context.isUnsigned(context.locals()[name]));
+	return result;
 }
 
 Value* NMethodCall::codeGen(CodeGenContext& context) {
 	Function *function = context.module->getFunction(id.name.c_str());
+	if (function == NULL && context.locals().find(id.name) == context.locals().end()) {
+		VectorType *vector = dyn_cast_or_null<VectorType>(vectorTypeOf(id.name));
+		Type *conversion = conversionTypeOf(id.name);
+		auto builtin = builtins.find(id.name);
+		if (vector || conversion || builtin != builtins.end()) {
+			if (spawn) {
+				ast_error("spawn needs a function, " + id.name + " is a builtin");
+				return NULL;
+			}
+			std::vector<Value*> args;
+			ExpressionList::const_iterator it;
+			for (it = arguments.begin(); it != arguments.end(); it++) {
+				Value* arg = (**it).codeGen(context);
+				if (arg == NULL) {
+					return NULL;
+				}
+				args.push_back(arg);
+			}
+			cout << "Creating builtin call: " << id.name << endl;
+			if (vector) {
+				Value* result = vectorConstruct(context, vector, isUnsignedType(id.name), args);
+				return isUnsignedType(id.name) ? unsignedValue(context, result) : result;
+			}
+			if (conversion) {
+				if (args.size() != 1) {
+					ast_error(id.name + " converts exactly one value");
+					return NULL;
+				}
+				return convertValue(context, args[0], conversion, isUnsignedType(id.name));
+			}
+			return builtin->second(context, args);
+		}
+	}
 	if (function == NULL) {
 		if (context.locals().find(id.name) == context.locals().end()) {
 			cerr << "no such function " << id.name << endl;
@@ -204,6 +2247,9 @@ Value* NMethodCall::codeGen(CodeGenContext& context) {
 		for (it = arguments.begin(); it != arguments.end(); it++) {
 			args.push_back((**it).codeGen(context));
 		}
+		if (spawn) {
+			return spawnCall(context, function1, args);
+		}
 		/* Effectively call the method*/
 		CallInst *call = Builder.CreateCall(function1, makeArrayRef(args));
 		cout << "Creating method call: " << id.name << endl;
@@ -212,11 +2258,39 @@ Value* NMethodCall::codeGen(CodeGenContext& context) {
 	/* Execute expressions in arguments */
 	std::vector<Value*> args;
 	ExpressionList::const_iterator it;
+	auto param = function->arg_begin();
 	for (it = arguments.begin(); it != arguments.end(); it++) {
-		args.push_back((**it).codeGen(context));
+		Value* arg = (**it).codeGen(context);
+		// put(m, k, v) on a map, every module also declares the runtime's put(char*)
+		if (args.empty() && id.name == "put" && !spawn && arg != NULL && mapOf(arg->getType())
+				&& (param == function->arg_end() || param->getType() != arg->getType())) {
+			args.push_back(arg);
+			for (it++; it != arguments.end(); it++) {
+				if ((arg = (**it).codeGen(context)) == NULL) {
+					return NULL;
+				}
+				args.push_back(arg);
+			}
+			return mapPutBuiltin(context, args);
+		}
+		if (param != function->arg_end()) {
+			if (arg != NULL && context.isByteArray(arg) && !context.isByteArray(&*param)) {
+				ast_error("cannot pass a byte array as string argument " + to_string(param->getArgNo() + 1) + " of " + id.name);
+				return NULL;
+			}
+			arg = adaptLiteral(context, arg, param->getType(), context.isUnsigned(&*param));
+			param++;
+		} else if (function->isVarArg() && arg != NULL) {
+			arg = promoteVararg(context, arg);
+		}
+		args.push_back(arg);
+	}
+	if (spawn) {
+		return spawnCall(context, function, args);
 	}
 	/* Effectively call the method*/
 	CallInst *call = Builder.CreateCall(function, makeArrayRef(args));
+	context.setUnsigned(call, context.isUnsigned(function));
 
 	cout << "Creating method call: " << id.name << endl;
 	return call;
@@ -225,15 +2299,15 @@ Value* NMethodCall::codeGen(CodeGenContext& context) {
 Value* NUnaryOperator::codeGen(CodeGenContext& context) {
 	cout << "Creating unary operation " << op << endl;
 	Value* right = rightSide.codeGen(context);
+	Type* scalar = right->getType()->getScalarType();
 
 	switch (op) {
 		case TMINUS:
-			if (getTypeString(right) == "i32")
-				return Builder.CreateSub(ConstantInt::get(Type::getInt32Ty(TheContext), 0, true), right);
-			if (getTypeString(right) == "i64")
-				return Builder.CreateSub(ConstantInt::get(Type::getInt64Ty(TheContext), 0, true), right);
-			if (getTypeString(right) == "double")
-				return Builder.CreateFSub(ConstantFP::get(Type::getDoubleTy(TheContext), 0.0), right);
+			// vectors negate every lane
+			if (scalar->isIntegerTy() && !scalar->isIntegerTy(1))
+				return Builder.CreateSub(ConstantInt::get(right->getType(), 0, true), right);
+			if (scalar->isFloatingPointTy())
+				return Builder.CreateFSub(ConstantFP::get(right->getType(), 0.0), right);
 			ast_error("unsupport calculate for " + getTypeString(right));
 			break;
 		default:
@@ -244,93 +2318,155 @@ Value* NUnaryOperator::codeGen(CodeGenContext& context) {
 	return NULL;
 }
 
+/* await t: an async function suspends until t is done, anything else runs the event loop until it is */
+Value* NAwait::codeGen(CodeGenContext& context) {
+	cout << "Creating await" << endl;
+	Value* value = task.codeGen(context);
+	if (value == NULL) {
+		return NULL;
+	}
+	const TaskType* type = taskOf(value->getType());
+	if (type == NULL) {
+		ast_error("await needs a task, not " + getTypeString(value));
+		return NULL;
+	}
+	Value* handle = Builder.CreateBitCast(value, Type::getInt8PtrTy(TheContext));
+	CodeGenBlock* block = context.currentBlock();
+	if (block->task) {
+		Function* function = Builder.GetInsertBlock()->getParent();
+		BasicBlock* wait = BasicBlock::Create(TheContext, "await.suspend", function);
+		BasicBlock* ready = BasicBlock::Create(TheContext, "await.ready", function);
+		Value* done = callRuntime(context, "__coo_task_await", Type::getInt32Ty(TheContext), {block->task, handle});
+		Builder.CreateCondBr(Builder.CreateICmpNE(done, Builder.getInt32(0)), ready, wait);
+		Builder.SetInsertPoint(wait);
+		Value* suspend = Builder.CreateCall(coroutineIntrinsic(context, Intrinsic::coro_suspend),
+			{ConstantTokenNone::get(TheContext), Builder.getFalse()});
+		SwitchInst* next = Builder.CreateSwitch(suspend, block->coroutineSuspend, 2);
+		next->addCase(Builder.getInt8(0), ready);
+		next->addCase(Builder.getInt8(1), block->coroutineCleanup);
+		Builder.SetInsertPoint(ready);
+	} else {
+		callRuntime(context, "__coo_task_wait", Type::getVoidTy(TheContext), {handle});
+	}
+
+	// the task and its frame are gone after this
+	Value* bits = callRuntime(context, "__coo_task_result", Type::getInt64Ty(TheContext), {handle});
+	if (type->result->isVoidTy()) {
+		return bits;
+	}
+	Value* result = slotDecode(bits, type->result);
+	context.setUnsigned(result, type->resultUnsigned);
+	return result;
+}
+
 Value* NBinaryOperator::codeGen(CodeGenContext& context) {
 	cout << "Creating binary operation " << op << endl;
 	Value* left = leftSide.codeGen(context);
 	Value* right = rightSide.codeGen(context);
+	if (left == NULL || right == NULL) {
+		return NULL;
+	}
+	if (op == TPLUS && (isText(context, left) || isText(context, right))) {
+		return stringConcat(context, left, right);
+	}
+
+	// unsigned if either side is, a plain literal takes the type of the other side
+	bool isUnsigned = context.isUnsigned(left) || context.isUnsigned(right);
+	left = adaptLiteral(context, left, right->getType()->getScalarType(), isUnsigned);
+	right = adaptLiteral(context, right, left->getType()->getScalarType(), isUnsigned);
+
+	// a scalar next to a vector applies to every lane
+	if (left->getType()->isVectorTy() && right->getType() == left->getType()->getVectorElementType()) {
+		right = Builder.CreateVectorSplat(left->getType()->getVectorNumElements(), right);
+	} else if (right->getType()->isVectorTy() && left->getType() == right->getType()->getVectorElementType()) {
+		left = Builder.CreateVectorSplat(right->getType()->getVectorNumElements(), left);
+	}
 
 	if (getTypeString(left) != getTypeString(right)) {
 		cerr << "[ERROR]variables type aren't equal: left is "
 			<< getTypeString(left) << ", right is " << getTypeString(right) << endl;
 		return NULL;
 	}
-
+	// vectors work lane by lane, so the element type picks the instruction
+	Type* scalar = left->getType()->getScalarType();
+	bool integer = scalar->isIntegerTy() && !scalar->isIntegerTy(1);
+	bool fp = scalar->isFloatingPointTy();
+	// bool compares like an integer
+	bool ordered = scalar->isIntegerTy();
+
+	Value* result = NULL;
 	switch (op) {
 		case TPLUS:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64")
-				return Builder.CreateAdd(left, right);
-			if (getTypeString(left) == "double")
-				return Builder.CreateFAdd(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
+			if (integer)
+				result = Builder.CreateAdd(left, right);
+			else if (fp)
+				result = Builder.CreateFAdd(left, right);
 			break;
 		case TMINUS:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64")
-				return Builder.CreateSub(left, right);
-			if (getTypeString(left) == "double")
-				return Builder.CreateFSub(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
+			if (integer)
+				result = Builder.CreateSub(left, right);
+			else if (fp)
+				result = Builder.CreateFSub(left, right);
 			break;
 		case TMUL:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64")
-				return Builder.CreateMul(left, right);
-			if (getTypeString(left) == "double")
-				return Builder.CreateFMul(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
+			if (integer)
+				result = Builder.CreateMul(left, right);
+			else if (fp)
+				result = Builder.CreateFMul(left, right);
 			break;
 		case TDIV:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64")
-				return Builder.CreateSDiv(left, right);
-			if (getTypeString(left) == "double")
-				return Builder.CreateFDiv(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
+			if (integer)
+				result = isUnsigned ? Builder.CreateUDiv(left, right) : Builder.CreateSDiv(left, right);
+			else if (fp)
+				result = Builder.CreateFDiv(left, right);
 			break;
 		case TCEQ:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
+			if (ordered)
 				return Builder.CreateICmpEQ(left, right);
-			if (getTypeString(left) == "double")
+			if (fp)
 				return Builder.CreateFCmpOEQ(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		case TCNE:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
+			if (ordered)
 				return Builder.CreateICmpNE(left, right);
-			if (getTypeString(left) == "double")
+			if (fp)
 				return Builder.CreateFCmpONE(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		case TCLT:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
-				return Builder.CreateICmpSLT(left, right);
-			if (getTypeString(left) == "double")
+			if (ordered)
+				return isUnsigned ? Builder.CreateICmpULT(left, right) : Builder.CreateICmpSLT(left, right);
+			if (fp)
 				return Builder.CreateFCmpOLT(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		case TCLE:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
-				return Builder.CreateICmpSLE(left, right);
-			if (getTypeString(left) == "double")
+			if (ordered)
+				return isUnsigned ? Builder.CreateICmpULE(left, right) : Builder.CreateICmpSLE(left, right);
+			if (fp)
 				return Builder.CreateFCmpOLE(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		case TCGT:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
-				return Builder.CreateICmpSGT(left, right);
-			if (getTypeString(left) == "double")
+			if (ordered)
+				return isUnsigned ? Builder.CreateICmpUGT(left, right) : Builder.CreateICmpSGT(left, right);
+			if (fp)
 				return Builder.CreateFCmpOGT(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		case TCGE:
-			if (getTypeString(left) == "i32" || getTypeString(left) == "i64" || getTypeString(left) == "i1")
-				return Builder.CreateICmpSGE(left, right);
-			if (getTypeString(left) == "double")
+			if (ordered)
+				return isUnsigned ? Builder.CreateICmpUGE(left, right) : Builder.CreateICmpSGE(left, right);
+			if (fp)
 				return Builder.CreateFCmpOGE(left, right);
-			ast_error("unsupport calculate for " + getTypeString(left));
 			break;
 		default:
-			ast_error("unsupport calculate for calculator: " + op);
-			break;
+			ast_error("unsupport calculate for calculator: " + to_string(op));
+			return NULL;
 	}
-	return NULL;
+
+	if (result == NULL) {
+		ast_error("unsupport calculate for " + getTypeString(left));
+		return NULL;
+	}
+	context.setUnsigned(result, isUnsigned);
+	return result;
 }
 
 Value* NBlock::codeGen(CodeGenContext& context) {
@@ -338,6 +2474,7 @@ Value* NBlock::codeGen(CodeGenContext& context) {
 	Value *last = NULL;
 	for (it = statements.begin(); it != statements.end(); it++) {
 		cout << "Generating code for ===== " << typeid(**it).name() << endl;
+		context.debugLocation((**it).line, (**it).column);
 		last = (**it).codeGen(context);
 		// break block generating if ret statement
 		if (typeid(**it).name() == "4NRet")  {
@@ -351,6 +2488,19 @@ Value* NBlock::codeGen(CodeGenContext& context) {
 
 Value* NAssignment::codeGen(CodeGenContext& context) {
 	cout << "Creating assignment for " << leftSide.name << endl;
+	if (!leftSide.field.empty()) {
+		Value* address = getFieldAddress(context, leftSide);
+		Value* val = rightSide.codeGen(context);
+		if (address == NULL || val == NULL) {
+			return NULL;
+		}
+		val = adaptLiteral(context, val, address->getType()->getPointerElementType(), context.isUnsigned(address));
+		if (val->getType() != address->getType()->getPointerElementType()) {
+			ast_error("cannot assign " + getTypeString(val) + " to field " + leftSide.field + " !");
+			return NULL;
+		}
+		return Builder.CreateStore(val, address, false);
+	}
 	if (context.locals().find(leftSide.name) == context.locals().end()) {
 		cerr << "undeclared variable " << leftSide.name << endl;
 		return NULL;
@@ -361,11 +2511,20 @@ Value* NAssignment::codeGen(CodeGenContext& context) {
 		return context.locals()[val->getName()];
 	}
 
-	if (leftSide.index && context.locals()[leftSide.name]->getType()->isPtrOrPtrVectorTy()) {
-		return Builder.CreateStore(val, getArrayIndex(context.locals()[leftSide.name], leftSide.index->codeGen(context)), false);
-	} else {
-		return Builder.CreateStore(val, context.locals()[leftSide.name], false);
+	Value* variable = context.locals()[leftSide.name];
+	if (leftSide.index && mapOf(variable->getType()->getPointerElementType())) {
+		return mapPut(context, Builder.CreateLoad(variable, ""), leftSide.index->codeGen(context), val);
+	}
+	Value* address = variable;
+	if (leftSide.index && variable->getType()->isPtrOrPtrVectorTy()) {
+		address = getArrayIndex(variable, leftSide.index->codeGen(context));
+	}
+	if (address == variable && context.isByteArray(val) && !context.isByteArray(variable)) {
+		ast_error("cannot assign a byte array to the string " + leftSide.name);
+		return NULL;
 	}
+	val = adaptLiteral(context, val, address->getType()->getPointerElementType(), context.isUnsigned(variable));
+	return Builder.CreateStore(val, address, false);
 }
 
 Value* NIfStatement::codeGen(CodeGenContext& context) {
@@ -415,6 +2574,9 @@ Value* NForStatement::codeGen(CodeGenContext& context) {
 
 	// body and after block
 	Function *TheFunction = Builder.GetInsertBlock()->getParent();
+	int region = -1;
+	if (context.instrument)
+		region = context.profileEnter(TheFunction->getName().str() + ":for@" + to_string(line));
 	BasicBlock *endCondBB = BasicBlock::Create(TheContext, "endcondBB", TheFunction);
 	BasicBlock *LoopBB = BasicBlock::Create(TheContext, "loopBB", TheFunction);
 	BasicBlock *AfterBB = BasicBlock::Create(TheContext, "afterloopBB", TheFunction);
@@ -430,25 +2592,38 @@ Value* NForStatement::codeGen(CodeGenContext& context) {
 	// body and step generate
 	Builder.SetInsertPoint(LoopBB);
 	block.codeGen(context);
+	context.debugLocation(line, column);
 	if (step)
 		step->codeGen(context);
 	Builder.CreateBr(endCondBB);
 
 	// after loop
 	Builder.SetInsertPoint(AfterBB);
+	if (context.instrument)
+		context.profileExit(region);
 
 	return NULL;
 }
 
 Value* NExpressionStatement::codeGen(CodeGenContext& context) {
 	cout << "Generating code for " << typeid(expression).name() << endl;
-	return expression.codeGen(context);
+	Value* value = expression.codeGen(context);
+	// the task of a call nobody can await any more frees itself once done
+	if (value && taskOf(value->getType()) && dynamic_cast<NMethodCall*>(&expression)) {
+		callRuntime(context, "__coo_task_detach", Type::getVoidTy(TheContext),
+			{Builder.CreateBitCast(value, Type::getInt8PtrTy(TheContext))});
+	}
+	return value;
 }
 
 Value* NRet::codeGen(CodeGenContext& context) {
 	cout << "Generating ret for " << typeid(expression).name() << endl;
 
-	Builder.CreateStore(expression.codeGen(context), context.currentBlock()->returnValue);
+	Value* returnValue = context.currentBlock()->returnValue;
+	Function* function = Builder.GetInsertBlock()->getParent();
+	Value* val = adaptLiteral(context, expression.codeGen(context),
+		returnValue->getType()->getPointerElementType(), context.isUnsigned(function));
+	Builder.CreateStore(val, returnValue);
 
 	return NULL;
 }
@@ -465,11 +2640,28 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context) {
 
 	AllocaInst *alloc;
 	auto ty = typeOf(type);
-	if (arraySize > 0) {
+	if (soa) {
+		StructType *record = dyn_cast<StructType>(ty);
+		if (record == NULL || arraySize <= 0) {
+			ast_error("@soa needs a fixed size array of a struct");
+			return NULL;
+		}
+		// one array per field: a loop over a[i].x streams through a.x alone
+		for (unsigned i = 0; i < record->getNumElements(); i++) {
+			std::string column = id.name + "." + structFields[type.name][i];
+			auto columnType = ArrayType::get(record->getElementType(i), arraySize);
+			alloc = new AllocaInst(columnType, 0, column.c_str(), (Instruction *)context.currentBlock()->returnValue);
+			context.setUnsigned(alloc, unsignedFields.find(type.name + "." + structFields[type.name][i]) != unsignedFields.end());
+			context.debugVariable(alloc, column, line);
+			context.locals()[column] = alloc;
+		}
+		return alloc;
+	} else if (arraySize > 0) {
 		// array type
 		Value* arraySizeValue = NInteger(arraySize).codeGen(context);
 		auto arrayType = ArrayType::get(typeOf(type), arraySize);
 		alloc = Builder.CreateAlloca(arrayType, arraySizeValue, id.name.c_str());
+		context.setUnsigned(alloc, isUnsignedType(type.name));
 
 		// array value initializing
 		std::vector<Value*> values;
@@ -480,7 +2672,8 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context) {
 			indices.push_back(ConstantInt::get(Type::getInt64Ty(TheContext), i, true));
 			auto idx = Builder.CreateInBoundsGEP(alloc, makeArrayRef(indices), "");
 
-			Builder.CreateStore((*arrayValue[i]).codeGen(context), idx);
+			Value* val = adaptLiteral(context, (*arrayValue[i]).codeGen(context), ty, isUnsignedType(type.name));
+			Builder.CreateStore(val, idx);
 		}
 	} else {
 		if (type.name == "func") {
@@ -502,6 +2695,9 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context) {
 				}
 			} else {
 				val = assignmentExpr->codeGen(context);
+				if (type.name != "") {
+					val = adaptLiteral(context, val, ty, isUnsignedType(type.name));
+				}
 				// type inferring
 				if (type.name != "" && getTypeString(val) != getTypeString(ty)) {
 					ast_error("cannot cast " + getTypeString(val) + " to " + getTypeString(ty) + " !");
@@ -512,16 +2708,53 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context) {
 			}
 
 			alloc = new AllocaInst(ty, 0, id.name.c_str(), (Instruction *)context.currentBlock()->returnValue);
-			if (val)
+			// declared unsigned, or inferred from an unsigned value
+			context.setUnsigned(alloc, type.name == "" ? context.isUnsigned(val) : isUnsignedType(type.name));
+			context.setByteArray(alloc, val && context.isByteArray(val));
+			if (val) {
 				Builder.CreateStore(val, alloc, false);
+			} else if (Value* initial = initialValue(context, ty, capacity)) {
+				Builder.CreateStore(initial, alloc, false);
+			}
 		}
 	}
 
+	context.debugVariable(alloc, id.name, line);
 	context.locals()[id.name] = alloc;
 	return alloc;
 }
 
+Value* NStructDeclaration::codeGen(CodeGenContext& context) {
+	cout << "Creating struct declaration " << id.name << endl;
+	if (structTypes.find(id.name) != structTypes.end()) {
+		ast_error("struct " + id.name + " is already declared");
+		return NULL;
+	}
+
+	std::vector<Type*> fieldTypes;
+	std::vector<std::string> fieldNames;
+	VariableList::const_iterator it;
+	for (it = fields.begin(); it != fields.end(); it++) {
+		Type *fieldType = typeOf((**it).type, (**it).funcType, (**it).funcParams);
+		if (fieldType->isVoidTy()) {
+			ast_error("unknown type " + (**it).type.name + " of field " + (**it).id.name);
+			return NULL;
+		}
+		fieldTypes.push_back(fieldType);
+		fieldNames.push_back((**it).id.name);
+		if (isUnsignedType((**it).type.name)) {
+			unsignedFields.insert(id.name + "." + (**it).id.name);
+		}
+	}
+	structTypes[id.name] = StructType::create(TheContext, makeArrayRef(fieldTypes), id.name);
+	structFields[id.name] = fieldNames;
+	return NULL;
+}
+
 Value* NFunctionDeclaration::codeGen(CodeGenContext& context) {
+	// nothing can call it, no IR, no symbol and no passes over it
+	if (!reachable)
+		return NULL;
 	cout << "Generating function statement" << endl;
 	std::vector<Type*> argTypes;
 	VariableList::const_iterator it;
@@ -529,33 +2762,51 @@ Value* NFunctionDeclaration::codeGen(CodeGenContext& context) {
 		cout << "function argument: " << (**it).type.name << endl;
 		argTypes.push_back(typeOf((**it).type, (**it).funcType, (**it).funcParams));
 	}
-	FunctionType *ftype = FunctionType::get(typeOf(type), makeArrayRef(argTypes), false);
+	Type *resultType = typeOf(type);
+	// an async function hands out its task right away, the result comes with await
+	Type *returnType = isAsync ? taskTypeOf(type.name, resultType) : resultType;
+	FunctionType *ftype = FunctionType::get(returnType, makeArrayRef(argTypes), false);
 	Function *function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
 	context.locals()[id.name] = function;
+	context.setUnsigned(function, isUnsignedType(type.name));
 
 	BasicBlock *bblock = BasicBlock::Create(TheContext, "entry", function);
 	BasicBlock *retblock = BasicBlock::Create(TheContext, "retBlock", function);
 
 	// store context before function
 	auto *originBlock = Builder.GetInsertBlock();
+	auto originLocation = Builder.getCurrentDebugLocation();
 	Builder.SetInsertPoint(bblock);
 	context.pushBlock(bblock);
+	context.debugFunction(function, line);
 	context.currentBlock()->returnBlock = retblock;
 	// return value initialize
-	if (typeOf(type)->isVoidTy()) {
+	if (resultType->isVoidTy()) {
 		context.currentBlock()->returnValue = Builder.CreateAlloca(Type::getInt32Ty(TheContext), 0, NULL, "");
 	} else {
-		context.currentBlock()->returnValue = Builder.CreateAlloca(typeOf(type), 0, NULL, "");
+		context.currentBlock()->returnValue = Builder.CreateAlloca(resultType, 0, NULL, "");
+	}
+	if (isAsync) {
+		coroutineBegin(context, function);
 	}
 
 	// arguments initialize
 	it = arguments.begin();
 	auto *arg = function->args().begin();
 	for (; it != arguments.end() && arg != function->args().end(); it++, arg++) {
-		AllocaInst *alloc = Builder.CreateAlloca(typeOf((**it).type, (**it).funcType, (**it).funcParams), 0, NULL, (**it).id.name.c_str());
+		AllocaInst *alloc = new AllocaInst(typeOf((**it).type, (**it).funcType, (**it).funcParams), 0,
+			(**it).id.name.c_str(), (Instruction *)context.currentBlock()->returnValue);
 		context.locals()[(**it).id.name] = alloc;
+		context.setUnsigned(alloc, isUnsignedType((**it).type.name));
+		context.setUnsigned(&*arg, isUnsignedType((**it).type.name));
+		bool byteArray = (**it).type.name.compare(0, 2, "[]") == 0;
+		context.setByteArray(alloc, byteArray);
+		context.setByteArray(&*arg, byteArray);
+		context.debugVariable(alloc, (**it).id.name, (**it).line, arg->getArgNo() + 1);
 		Builder.CreateStore(arg, alloc);
 	}
+	// tasks interleave, their regions would not nest
+	int region = context.instrument && !isAsync ? context.profileEnter(function->getName().str()) : -1;
 
 	// block generate
 	block.codeGen(context);
@@ -565,7 +2816,12 @@ Value* NFunctionDeclaration::codeGen(CodeGenContext& context) {
 		Builder.CreateBr(retblock);
 	}
 	Builder.SetInsertPoint(retblock);
-	if (typeOf(type)->isVoidTy()) {
+	if (region >= 0)
+		context.profileExit(region);
+	if (isAsync) {
+		Value* result = resultType->isVoidTy() ? NULL : Builder.CreateLoad(context.currentBlock()->returnValue);
+		coroutineEnd(context, returnType, result, isUnsignedType(type.name));
+	} else if (resultType->isVoidTy()) {
 		Builder.CreateRetVoid();
 	} else {
 		Builder.CreateRet(Builder.CreateLoad(context.currentBlock()->returnValue));
@@ -573,7 +2829,9 @@ Value* NFunctionDeclaration::codeGen(CodeGenContext& context) {
 
 	// restore context after function
 	context.popBlock();
+	context.debugFunctionEnd();
 	Builder.SetInsertPoint(originBlock);
+	Builder.SetCurrentDebugLocation(originLocation);
 	cout << "Creating function: " << id.name << endl;
 	return function;
 }
\ No newline at end of file
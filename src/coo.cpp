@@ -1,48 +1,42 @@
 #include <iostream>
-#include <fstream>
-#include "codegen.h"
-#include "ast.h"
-#include "objgen.h"
-
-
-extern NBlock* programBlock;
-extern int yyparse();
+#include <string>
+#include <vector>
+#include "driver.h"
+#include "server.h"
 
 int main(int argc, char **argv)
 {
 	/**
 	 * parse command line args
 	*/
-	std::string inFile = "";
-	std::string outFile = "";
-	if( argc == 3 ) {
-		inFile = argv[1];
-		outFile = argv[2];
+	std::vector<std::string> args(argv + 1, argv + argc);
+
+	if (!args.empty() && (args[0] == "--server" || args[0] == "--client")) {
+		std::string socketPath = defaultSocketPath();
+		std::vector<std::string> forwarded;
+		for (auto it = args.begin() + 1; it != args.end(); it++) {
+			if (it->compare(0, 9, "--socket=") == 0) {
+				socketPath = it->substr(9);
+			} else {
+				forwarded.push_back(*it);
+			}
+		}
+
+		if (args[0] == "--server") {
+			if (!forwarded.empty()) {
+				usage();
+				return 1;
+			}
+			return runServer(socketPath);
+		}
+		return runClient(socketPath, forwarded);
 	}
-	else {
-		std::cout << "Usage: ./coo [source_code_file_name] [target_file_name]\n";
+
+	CompileOptions options;
+	if (!parseOptions(args, options)) {
+		usage();
 		return 1;
 	}
 
-	// read source code
-	freopen(inFile.c_str(), "r", stdin);
-
-	// compiler front-end parse
-	yyparse();
-
-	// compiler back-end parse
-	CodeGenContext context = CodeGenContext(inFile);
-	context.generateCode(*programBlock);
-
-	// redirect stdout to file
-	std::cout << inFile << " compiling to llvm ir file: " << outFile + ".ll" << std::endl;
-	FILE *fp = freopen((outFile + ".ll").c_str(),"w",stdout);
-	context.module->print(outs(), nullptr);
-
-	// context.runCode();
-	ObjGen(context, outFile + ".o");
-	fflush(fp); freopen("/dev/tty", "w", stdout);
-	std::cout << "Object code wrote to " << outFile << ".o" << std::endl;
-
-	return 0;
+	return compile(options);
 }
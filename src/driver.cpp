@@ -0,0 +1,269 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Target/TargetMachine.h>
+#include "codegen.h"
+#include "ast.h"
+#include "objgen.h"
+#include "optimize.h"
+#include "linker.h"
+#include "jit.h"
+#include "driver.h"
+
+extern NBlock* programBlock;
+extern int yyparse();
+
+void usage() {
+	std::cout << "Usage: ./coo [-O<n>] [--emit=obj,asm,bc,ll] [source_code_file_name] [target_file_name]\n"
+		<< "       ./coo build [-o executable] [-O<n>] [--static] [--gc-sections] [source_code_file_name]\n"
+		<< "       ./coo --jit [--perf-map] [-O<n>] [source_code_file_name]\n"
+		<< "       all accept -g and --keep-frame-pointers\n"
+		<< "       the first two accept --instrument, --profile-generate[=dir] or --profile-use=file.profdata\n"
+		<< "       and --backend-threads=N to generate object code on N threads\n"
+		<< "       ./coo --server [--socket=path]\n"
+		<< "       ./coo --client [--socket=path] [source_code_file_name] [target_file_name]\n";
+}
+
+/* Fill options from command line args (without the program name) */
+bool parseOptions(const std::vector<std::string>& args, CompileOptions& options) {
+	std::vector<std::string> positional;
+	auto it = args.begin();
+	if (it != args.end() && *it == "build") {
+		options.build = true;
+		it++;
+	}
+
+	for (; it != args.end(); it++) {
+		const std::string& arg = *it;
+		if (arg == "-o" && options.build) {
+			if (++it == args.end()) {
+				return false;
+			}
+			options.outFile = *it;
+		} else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '3') {
+			options.optLevel = arg[2] - '0';
+		} else if (arg.compare(0, 7, "--emit=") == 0 && !options.build) {
+			std::stringstream kinds(arg.substr(7));
+			std::string kind;
+			while (std::getline(kinds, kind, ',')) {
+				if (kind == "obj") {
+					options.emit |= EMIT_OBJ;
+				} else if (kind == "asm") {
+					options.emit |= EMIT_ASM;
+				} else if (kind == "bc") {
+					options.emit |= EMIT_BC;
+				} else if (kind == "ll") {
+					options.emit |= EMIT_LL;
+				} else {
+					std::cerr << "unknown emit kind " << kind << std::endl;
+					return false;
+				}
+			}
+		} else if (arg == "-g") {
+			options.debugInfo = true;
+		} else if (arg == "--keep-frame-pointers") {
+			options.keepFramePointers = true;
+		} else if (arg == "--jit" && !options.build) {
+			options.jit = true;
+		} else if (arg == "--perf-map") {
+			options.perfMap = true;
+		} else if (arg == "--instrument") {
+			options.instrument = true;
+		} else if (arg == "--profile-generate") {
+			options.profileGenerate = "default_%m.profraw";
+		} else if (arg.compare(0, 19, "--profile-generate=") == 0) {
+			options.profileGenerate = arg.substr(19) + "/default_%m.profraw";
+		} else if (arg.compare(0, 14, "--profile-use=") == 0) {
+			options.profileUse = arg.substr(14);
+		} else if (arg.compare(0, 18, "--backend-threads=") == 0) {
+			int threads = atoi(arg.substr(18).c_str());
+			if (threads < 1) {
+				std::cerr << "--backend-threads needs a positive thread count" << std::endl;
+				return false;
+			}
+			options.backendThreads = threads;
+		} else if (arg == "--static" && options.build) {
+			options.staticLink = true;
+		} else if (arg == "--gc-sections" && options.build) {
+			options.gcSections = true;
+		} else if (arg.size() > 1 && arg[0] == '-') {
+			std::cerr << "unknown option " << arg << std::endl;
+			return false;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+
+	if (!options.profileGenerate.empty() && !options.profileUse.empty()) {
+		std::cerr << "--profile-generate and --profile-use cannot be combined" << std::endl;
+		return false;
+	}
+	if (!options.profileUse.empty() && !sys::fs::exists(options.profileUse)) {
+		std::cerr << "profile " << options.profileUse << " does not exist" << std::endl;
+		return false;
+	}
+
+	if (options.perfMap && !options.jit) {
+		std::cerr << "--perf-map is only for --jit, AOT code has symbols already" << std::endl;
+		return false;
+	}
+	if (options.jit) {
+		// the profiler runtime keeps thread-local state, which MCJIT cannot relocate
+		if (options.instrument || !options.profileGenerate.empty() || options.emit != 0 || options.backendThreads > 1) {
+			std::cerr << "--jit cannot be combined with --instrument, --profile-generate, --emit or --backend-threads" << std::endl;
+			return false;
+		}
+		if (positional.size() != 1) {
+			return false;
+		}
+		options.inFile = positional[0];
+		if (options.optLevel < 0) {
+			options.optLevel = 0;
+		}
+		return true;
+	}
+
+	if (options.build) {
+		if (positional.size() != 1) {
+			return false;
+		}
+		options.inFile = positional[0];
+		if (options.outFile.empty()) {
+			options.outFile = "a.out";
+		}
+		if (options.optLevel < 0) {
+			options.optLevel = 2;
+		}
+		return true;
+	}
+
+	if (positional.size() != 2) {
+		return false;
+	}
+	options.inFile = positional[0];
+	options.outFile = positional[1];
+	if (options.optLevel < 0) {
+		options.optLevel = 0;
+	}
+	if (options.emit == 0) {
+		options.emit = EMIT_OBJ;
+	}
+	return true;
+}
+
+/* Object code in options.backendThreads temporary objects, the caller removes them; more than one consumes the module */
+static bool objectParts(CodeGenContext& context, const CompileOptions& options, std::vector<std::string>& objects) {
+	for (unsigned i = 0; i < options.backendThreads; i++) {
+		int fd;
+		SmallString<128> objectFile;
+		if (sys::fs::createTemporaryFile("coo", "o", fd, objectFile)) {
+			std::cerr << "cannot create a temporary object file" << std::endl;
+			return false;
+		}
+		close(fd);
+		objects.push_back(objectFile.str().str());
+	}
+
+	if (objects.size() == 1) {
+		return ObjGen(context, objects[0]);
+	}
+	return ObjGenParallel(context, objects);
+}
+
+static void removeObjects(const std::vector<std::string>& objects) {
+	for (auto& object : objects) {
+		sys::fs::remove(object);
+	}
+}
+
+/* coo build: runtime, whole program optimization and link, one output file */
+static int build(CodeGenContext& context, const CompileOptions& options) {
+	auto theTargetMachine = SetModuleTarget(context);
+	if (!theTargetMachine || !LinkRuntime(context)) {
+		return 1;
+	}
+	context.setFramePointers();
+	Optimize(context, options);
+
+	// sections per function let --gc-sections drop what the program never calls
+	theTargetMachine->Options.FunctionSections = options.gcSections;
+	theTargetMachine->Options.DataSections = options.gcSections;
+
+	std::vector<std::string> objects;
+	bool linked = objectParts(context, options, objects) && LinkExecutable(objects, options);
+	removeObjects(objects);
+	if (!linked) {
+		return 1;
+	}
+
+	std::cout << "Executable wrote to " << options.outFile << std::endl;
+	return 0;
+}
+
+int compile(const CompileOptions& options) {
+	const std::string& inFile = options.inFile;
+	const std::string& outFile = options.outFile;
+
+	// read source code
+	if (freopen(inFile.c_str(), "r", stdin) == NULL) {
+		std::cerr << "cannot open " << inFile << std::endl;
+		return 1;
+	}
+
+	// compiler front-end parse
+	yyparse();
+
+	// compiler back-end parse
+	CodeGenContext context = CodeGenContext(inFile);
+	context.instrument = options.instrument;
+	context.debugInfo = options.debugInfo;
+	context.keepFramePointers = options.keepFramePointers;
+	context.generateCode(*programBlock);
+
+	if (options.jit) {
+		return RunJIT(context, options);
+	}
+	if (options.build) {
+		return build(context, options);
+	}
+	Optimize(context, options);
+
+	// IR outputs first, code generation below rewrites parts of the module
+	if (options.emit & EMIT_LL) {
+		if (!IRGen(context, outFile + ".ll")) {
+			return 1;
+		}
+		std::cout << "LLVM IR wrote to " << outFile << ".ll" << std::endl;
+	}
+	if (options.emit & EMIT_BC) {
+		if (!IRGen(context, outFile + ".bc", true)) {
+			return 1;
+		}
+		std::cout << "LLVM bitcode wrote to " << outFile << ".bc" << std::endl;
+	}
+	if (options.emit & EMIT_ASM) {
+		if (!ObjGen(context, outFile + ".s", true)) {
+			return 1;
+		}
+		std::cout << "Assembly wrote to " << outFile << ".s" << std::endl;
+	}
+	if (options.emit & EMIT_OBJ) {
+		if (options.backendThreads > 1) {
+			// the parts are merged with ld -r, output.o stays a single object
+			std::vector<std::string> objects;
+			bool linked = objectParts(context, options, objects) && LinkRelocatable(objects, outFile + ".o");
+			removeObjects(objects);
+			if (!linked) {
+				return 1;
+			}
+		} else if (!ObjGen(context, outFile + ".o")) {
+			return 1;
+		}
+		std::cout << "Object code wrote to " << outFile << ".o" << std::endl;
+	}
+
+	return 0;
+}
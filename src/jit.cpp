@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Transforms/IPO.h>
+
+#include "codegen.h"
+#include "driver.h"
+#include "objgen.h"
+#include "optimize.h"
+#include "linker.h"
+#include "jit.h"
+
+using namespace llvm;
+
+/**
+ * Writes /tmp/perf-<pid>.map, the format perf reads to name samples that
+ * fall into anonymous executable memory: one "start size name" line in hex
+ * per JIT compiled function.
+ */
+class PerfMapListener : public JITEventListener {
+    FILE *map;
+
+public:
+    PerfMapListener() {
+        std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        map = fopen(path.c_str(), "w");
+        if( !map ){
+            errs() << "cannot open " << path << "\n";
+        }
+    }
+
+    ~PerfMapListener() override {
+        if( map ){
+            fclose(map);
+        }
+    }
+
+    void NotifyObjectEmitted(const object::ObjectFile &object,
+                             const RuntimeDyld::LoadedObjectInfo &info) override {
+        if( !map ){
+            return;
+        }
+        // the debug object has its symbols relocated to where they were loaded
+        object::OwningBinary<object::ObjectFile> loaded = info.getObjectForDebug(object);
+        if( !loaded.getBinary() ){
+            return;
+        }
+        for (const auto &symbolSize : object::computeSymbolSizes(*loaded.getBinary())) {
+            object::SymbolRef symbol = symbolSize.first;
+            Expected<object::SymbolRef::Type> type = symbol.getType();
+            if( !type ){
+                consumeError(type.takeError());
+                continue;
+            }
+            if( *type != object::SymbolRef::ST_Function ){
+                continue;
+            }
+            Expected<StringRef> name = symbol.getName();
+            if( !name ){
+                consumeError(name.takeError());
+                continue;
+            }
+            Expected<uint64_t> address = symbol.getAddress();
+            if( !address ){
+                consumeError(address.takeError());
+                continue;
+            }
+            fprintf(map, "%llx %llx %s\n", (unsigned long long)*address,
+                    (unsigned long long)symbolSize.second, name->str().c_str());
+        }
+        fflush(map);
+    }
+};
+
+/**
+ * coo --jit: link the runtime in, optimize and run main in-process. JIT code
+ * is registered with gdb, and with perf through a perf map on --perf-map.
+ */
+int RunJIT(CodeGenContext & context, const CompileOptions& options) {
+    if( !SetModuleTarget(context) || !LinkRuntime(context) ){
+        return 1;
+    }
+    context.setFramePointers();
+
+    // runtime code the program never calls is not worth compiling
+    legacy::PassManager pass;
+    pass.add(createInternalizePass([](const GlobalValue& value) {
+        return value.getName() == "main";
+    }));
+    pass.add(createGlobalDCEPass());
+    pass.run(*context.module);
+
+    Optimize(context, options);
+
+    std::string error;
+    auto level = options.optLevel >= 2 ? CodeGenOpt::Default : CodeGenOpt::None;
+    ExecutionEngine *engine = EngineBuilder(std::unique_ptr<Module>(context.module))
+        .setEngineKind(EngineKind::JIT)
+        .setErrorStr(&error)
+        .setOptLevel(level)
+        .setMCPU(sys::getHostCPUName())
+        .create();
+    if( !engine ){
+        std::cerr << "cannot create the JIT: " << error << std::endl;
+        return 1;
+    }
+
+    engine->RegisterJITEventListener(JITEventListener::createGDBRegistrationListener());
+    if( options.perfMap ){
+        engine->RegisterJITEventListener(new PerfMapListener());
+    }
+
+    Function *mainFunction = engine->FindFunctionNamed("main");
+    engine->finalizeObject();
+    std::cout << "Running code..." << std::endl;
+    GenericValue result = engine->runFunction(mainFunction, std::vector<GenericValue>());
+
+    // the engine is kept alive on purpose: runtime atexit handlers point into it
+    return (int)result.IntVal.getZExtValue();
+}
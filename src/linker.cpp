@@ -0,0 +1,175 @@
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <lld/Common/Driver.h>
+
+#include "codegen.h"
+#include "driver.h"
+#include "linker.h"
+
+// builtin_bc / builtin_bc_len: the runtime as bitcode, generated by make
+#include "builtin.bc.inc"
+
+using namespace llvm;
+
+/* Link the embedded runtime into the module so it is optimized with the program */
+bool LinkRuntime(CodeGenContext & context) {
+    StringRef bitcode((const char *)builtin_bc, builtin_bc_len);
+    auto runtime = parseBitcodeFile(MemoryBufferRef(bitcode, "builtin.bc"), context.module->getContext());
+    if( !runtime ){
+        errs() << "cannot load the embedded runtime: " << toString(runtime.takeError()) << "\n";
+        return false;
+    }
+
+    (*runtime)->setTargetTriple(context.module->getTargetTriple());
+    (*runtime)->setDataLayout(context.module->getDataLayout());
+    if( Linker::linkModules(*context.module, std::move(*runtime)) ){
+        errs() << "cannot link the runtime into " << context.module->getName() << "\n";
+        return false;
+    }
+    return true;
+}
+
+static std::string findFile(const std::vector<std::string>& dirs, const std::string& name) {
+    for (auto& dir : dirs) {
+        SmallString<128> path(dir);
+        sys::path::append(path, name);
+        if( sys::fs::exists(path) ){
+            return path.str().str();
+        }
+    }
+    return "";
+}
+
+/* Newest /usr/lib/gcc/<arch>-*\/<version> directory, home of crtbegin.o and libgcc */
+static std::string findGccLibDir(const std::string& arch) {
+    std::string best;
+    int bestVersion = -1;
+    std::error_code EC;
+    for (sys::fs::directory_iterator triple("/usr/lib/gcc", EC), end; !EC && triple != end; triple.increment(EC)) {
+        if( !sys::path::filename(triple->path()).startswith(arch) ){
+            continue;
+        }
+        std::error_code versionEC;
+        for (sys::fs::directory_iterator version(triple->path(), versionEC); !versionEC && version != end; version.increment(versionEC)) {
+            int major = atoi(sys::path::filename(version->path()).str().c_str());
+            if( major > bestVersion && sys::fs::exists(version->path() + "/crtbegin.o") ){
+                best = version->path();
+                bestVersion = major;
+            }
+        }
+    }
+    return best;
+}
+
+/* Link objects against the C library with LLD, without leaving the process */
+bool LinkExecutable(const std::vector<std::string>& objects, const CompileOptions& options) {
+    Triple triple(sys::getDefaultTargetTriple());
+    std::string emulation, dynamicLinker;
+    switch (triple.getArch()) {
+        case Triple::x86_64:
+            emulation = "elf_x86_64";
+            dynamicLinker = "/lib64/ld-linux-x86-64.so.2";
+            break;
+        case Triple::aarch64:
+            emulation = "aarch64linux";
+            dynamicLinker = "/lib/ld-linux-aarch64.so.1";
+            break;
+        default:
+            errs() << "in-process linking is not supported for " << triple.str() << "\n";
+            return false;
+    }
+
+    std::string multiarch = triple.getArchName().str() + "-linux-gnu";
+    std::vector<std::string> libDirs = {
+        "/usr/lib/" + multiarch, "/lib/" + multiarch, "/usr/lib64", "/lib64", "/usr/lib", "/lib"
+    };
+    std::string gccDir = findGccLibDir(triple.getArchName().str());
+    if( !gccDir.empty() ){
+        libDirs.insert(libDirs.begin(), gccDir);
+    }
+
+    std::string crt1 = findFile(libDirs, "crt1.o");
+    std::string crti = findFile(libDirs, "crti.o");
+    std::string crtn = findFile(libDirs, "crtn.o");
+    if( crt1.empty() || crti.empty() || crtn.empty() ){
+        errs() << "cannot find the C runtime start files (crt1.o, crti.o, crtn.o)\n";
+        return false;
+    }
+
+    std::vector<std::string> args = { "ld.lld", "-o", options.outFile, "-m", emulation, "--eh-frame-hdr" };
+    if( options.staticLink ){
+        args.push_back("-static");
+    } else {
+        args.push_back("-dynamic-linker");
+        args.push_back(dynamicLinker);
+    }
+    if( options.gcSections ){
+        args.push_back("--gc-sections");
+    }
+
+    args.push_back(crt1);
+    args.push_back(crti);
+    if( !gccDir.empty() ){
+        args.push_back(gccDir + (options.staticLink ? "/crtbeginT.o" : "/crtbegin.o"));
+    }
+    for (auto& dir : libDirs) {
+        args.push_back("-L" + dir);
+    }
+    args.insert(args.end(), objects.begin(), objects.end());
+
+    // instrumented programs write their .profraw from the compiler-rt profile runtime
+    if( !options.profileGenerate.empty() ){
+        std::string profileRuntime = std::string(COO_CLANG_RT_DIR) + "/libclang_rt.profile-" + triple.getArchName().str() + ".a";
+        if( !sys::fs::exists(profileRuntime) ){
+            errs() << "cannot find the profile runtime " << profileRuntime << "\n";
+            return false;
+        }
+        args.push_back(profileRuntime);
+    }
+
+    if( options.staticLink ){
+        args.push_back("--start-group");
+        args.push_back("-lpthread");
+        args.push_back("-lc");
+        if( !gccDir.empty() ){
+            args.push_back("-lgcc");
+            args.push_back("-lgcc_eh");
+        }
+        args.push_back("--end-group");
+    } else {
+        // spawn's worker pool
+        args.push_back("-lpthread");
+        args.push_back("-lc");
+        if( !gccDir.empty() ){
+            args.push_back("-lgcc");
+        }
+    }
+
+    if( !gccDir.empty() ){
+        args.push_back(gccDir + "/crtend.o");
+    }
+    args.push_back(crtn);
+
+    std::vector<const char *> argv;
+    for (auto& arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    return lld::elf::link(argv, false, errs());
+}
+
+/* Merge objects into one relocatable object, what --backend-threads hands out as output.o */
+bool LinkRelocatable(const std::vector<std::string>& objects, const std::string& output) {
+    std::vector<std::string> args = { "ld.lld", "-r", "-o", output };
+    args.insert(args.end(), objects.begin(), objects.end());
+
+    std::vector<const char *> argv;
+    for (auto& arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    return lld::elf::link(argv, false, errs());
+}
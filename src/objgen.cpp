@@ -10,6 +10,7 @@
 #include <llvm/Support/FormattedStream.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/CodeGen/ParallelCG.h>
 
 #include "codegen.h"
 #include "objgen.h"
@@ -17,23 +18,37 @@
 using namespace llvm;
 
 
-void ObjGen(CodeGenContext & context, const std::string& filename){
+/* Register all targets once per process, a compile server keeps them warm */
+void InitializeObjGen() {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+
     // Initialize the target registry etc.
     InitializeAllTargetInfos();
     InitializeAllTargets();
     InitializeAllTargetMCs();
     InitializeAllAsmParsers();
     InitializeAllAsmPrinters();
+    initialized = true;
+}
 
-    auto targetTriple = sys::getDefaultTargetTriple();
-    context.module->setTargetTriple(targetTriple);
+/* Target machines are cached per triple and reused by every compilation */
+TargetMachine* GetTargetMachine(const std::string& targetTriple) {
+    static std::map<std::string, TargetMachine*> targetMachines;
+    if (targetMachines.find(targetTriple) != targetMachines.end()) {
+        return targetMachines[targetTriple];
+    }
+
+    InitializeObjGen();
 
     std::string error;
     auto Target = TargetRegistry::lookupTarget(targetTriple, error);
 
     if( !Target ){
         errs() << error;
-        return;
+        return nullptr;
     }
 
     auto CPU = "generic";
@@ -42,25 +57,123 @@ void ObjGen(CodeGenContext & context, const std::string& filename){
     TargetOptions opt;
     auto RM = Optional<Reloc::Model>();
     auto theTargetMachine = Target->createTargetMachine(targetTriple, CPU, features, opt, RM);
+    targetMachines[targetTriple] = theTargetMachine;
+    return theTargetMachine;
+}
+
+/* Point the module at the host target, returns its target machine */
+TargetMachine* SetModuleTarget(CodeGenContext & context) {
+    auto targetTriple = sys::getDefaultTargetTriple();
+    auto theTargetMachine = GetTargetMachine(targetTriple);
+
+    if( theTargetMachine ){
+        context.module->setDataLayout(theTargetMachine->createDataLayout());
+        context.module->setTargetTriple(targetTriple);
+    }
+    return theTargetMachine;
+}
+
+/* Flush an output, false (and the error cleared, so the stream can be destroyed) if writing failed */
+static bool finishOutput(raw_fd_ostream& dest, const std::string& filename){
+    dest.flush();
+    if( dest.has_error() ){
+        errs() << "cannot write " << filename << "\n";
+        dest.clear_error();
+        return false;
+    }
+    return true;
+}
+
+/* Stream object code (or assembly) straight into filename */
+bool ObjGen(CodeGenContext & context, const std::string& filename, bool assembly){
+    auto theTargetMachine = SetModuleTarget(context);
 
-    context.module->setDataLayout(theTargetMachine->createDataLayout());
-    context.module->setTargetTriple(targetTriple);
+    if( !theTargetMachine ){
+        return false;
+    }
 
     std::error_code EC;
-    raw_fd_ostream dest(filename.c_str(), EC, sys::fs::F_None);
-//    raw_fd_ostream dest(filename.c_str(), EC, sys::fs::F_None);
-//    formatted_raw_ostream formattedRawOstream(dest);
+    raw_fd_ostream dest(filename.c_str(), EC, assembly ? sys::fs::F_Text : sys::fs::F_None);
+    if( EC ){
+        errs() << "cannot open " << filename << ": " << EC.message() << "\n";
+        return false;
+    }
 
     legacy::PassManager pass;
-    auto fileType = TargetMachine::CGFT_ObjectFile;
+    auto fileType = assembly ? TargetMachine::CGFT_AssemblyFile : TargetMachine::CGFT_ObjectFile;
 
     if( theTargetMachine->addPassesToEmitFile(pass, dest, fileType) ){
-        errs() << "theTargetMachine can't emit a file of this type";
-        return;
+        errs() << "theTargetMachine can't emit a file of this type\n";
+        return false;
     }
 
     pass.run(*context.module);
-    dest.flush();
+    return finishOutput(dest, filename);
+}
+
+/**
+ * Object code for the module on several threads, one object file per name.
+ *
+ * SplitModule cuts the module into that many parts and promotes internal
+ * symbols one part uses from another to hidden globals with unique names.
+ * Every part is generated in its own LLVMContext, so it gets its own target
+ * machine, configured like the shared one. The module is consumed:
+ * context.module is null afterwards.
+ */
+bool ObjGenParallel(CodeGenContext & context, const std::vector<std::string>& filenames){
+    auto theTargetMachine = SetModuleTarget(context);
+
+    if( !theTargetMachine ){
+        return false;
+    }
+
+    std::vector<std::unique_ptr<raw_fd_ostream>> files;
+    std::vector<raw_pwrite_stream *> streams;
+    for (auto& filename : filenames) {
+        std::error_code EC;
+        files.emplace_back(new raw_fd_ostream(filename.c_str(), EC, sys::fs::F_None));
+        if( EC ){
+            errs() << "cannot open " << filename << ": " << EC.message() << "\n";
+            return false;
+        }
+        streams.push_back(files.back().get());
+    }
 
-    return;
+    const Target& target = theTargetMachine->getTarget();
+    auto targetMachineFactory = [&]() {
+        return std::unique_ptr<TargetMachine>(target.createTargetMachine(
+            theTargetMachine->getTargetTriple().str(), theTargetMachine->getTargetCPU(),
+            theTargetMachine->getTargetFeatureString(), theTargetMachine->Options,
+            theTargetMachine->getRelocationModel(), theTargetMachine->getCodeModel(),
+            theTargetMachine->getOptLevel()));
+    };
+
+    // object code is the last output, splitting takes the module itself instead of a copy
+    std::unique_ptr<Module> module(context.module);
+    context.module = nullptr;
+    splitCodeGen(std::move(module), streams, {}, targetMachineFactory);
+    bool written = true;
+    for (size_t i = 0; i < files.size(); i++) {
+        written = finishOutput(*files[i], filenames[i]) && written;
+    }
+    return written;
+}
+
+/* Write the module as textual IR, or as bitcode */
+bool IRGen(CodeGenContext & context, const std::string& filename, bool bitcode){
+    SetModuleTarget(context);
+
+    std::error_code EC;
+    raw_fd_ostream dest(filename.c_str(), EC, bitcode ? sys::fs::F_None : sys::fs::F_Text);
+    if( EC ){
+        errs() << "cannot open " << filename << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    if( bitcode ){
+        WriteBitcodeToFile(context.module, dest);
+    } else {
+        context.module->print(dest, nullptr);
+    }
+    return finishOutput(dest, filename);
 }
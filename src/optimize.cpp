@@ -0,0 +1,93 @@
+#include <iostream>
+#include <algorithm>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/Coroutines.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include "codegen.h"
+#include "objgen.h"
+#include "driver.h"
+#include "optimize.h"
+
+using namespace llvm;
+
+/**
+ * Run the standard -O pipeline over the module. A whole program build has
+ * the runtime linked in already, so everything but main is internalized and
+ * unused code can be dropped before the linker ever sees it.
+ *
+ * PGO instrumentation and profile annotation are part of the -O pipeline,
+ * so asking for either one optimizes at least at -O1.
+ *
+ * Async functions are coroutines the backend cannot emit as they are, the
+ * coroutine passes split them into ramp, resume and destroy functions at
+ * every level, -O0 included.
+ */
+void Optimize(CodeGenContext & context, const CompileOptions& options) {
+    auto theTargetMachine = SetModuleTarget(context);
+    bool pgo = !options.profileGenerate.empty() || !options.profileUse.empty();
+    int optLevel = pgo ? std::max(options.optLevel, 1) : options.optLevel;
+    bool coroutines = context.module->getFunction("llvm.coro.id") != nullptr;
+    if( coroutines && optLevel <= 0 ){
+        legacy::PassManager coroutinePasses;
+        coroutinePasses.add(createCoroEarlyPass());
+        coroutinePasses.add(createCoroSplitPass());
+        coroutinePasses.add(createCoroElidePass());
+        coroutinePasses.add(createCoroCleanupPass());
+        coroutinePasses.run(*context.module);
+    }
+    if( !theTargetMachine || optLevel <= 0 ){
+        return;
+    }
+
+    std::cout << "Optimizing at -O" << optLevel << std::endl;
+
+    legacy::PassManager modulePasses;
+    legacy::FunctionPassManager functionPasses(context.module);
+    modulePasses.add(createTargetTransformInfoWrapperPass(theTargetMachine->getTargetIRAnalysis()));
+    functionPasses.add(createTargetTransformInfoWrapperPass(theTargetMachine->getTargetIRAnalysis()));
+
+    if( options.build ){
+        modulePasses.add(createInternalizePass([](const GlobalValue& value) {
+            return value.getName() == "main";
+        }));
+    }
+
+    PassManagerBuilder builder;
+    builder.OptLevel = optLevel;
+    builder.SizeLevel = 0;
+    if( optLevel > 1 ){
+        builder.Inliner = createFunctionInliningPass(optLevel, 0, false);
+    } else {
+        builder.Inliner = createAlwaysInlinerLegacyPass();
+    }
+    builder.LoopVectorize = optLevel > 1;
+    builder.SLPVectorize = optLevel > 1;
+    if( !options.profileGenerate.empty() ){
+        builder.EnablePGOInstrGen = true;
+        builder.PGOInstrGen = options.profileGenerate;
+        std::cout << "Instrumenting for profile " << options.profileGenerate << std::endl;
+    }
+    if( !options.profileUse.empty() ){
+        builder.PGOInstrUse = options.profileUse;
+        std::cout << "Using profile " << options.profileUse << std::endl;
+    }
+    theTargetMachine->adjustPassManager(builder);
+    if( coroutines ){
+        addCoroutinePassesToExtensionPoints(builder);
+    }
+
+    builder.populateFunctionPassManager(functionPasses);
+    builder.populateModulePassManager(modulePasses);
+
+    functionPasses.doInitialization();
+    for (Function &function : *context.module) {
+        functionPasses.run(function);
+    }
+    functionPasses.doFinalization();
+    modulePasses.run(*context.module);
+}
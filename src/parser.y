@@ -6,11 +6,32 @@
 #include "ast.h"
 NBlock *programBlock;
 
+/* location of the rule being reduced, picked up by the Node constructor */
+int node_line = 0;
+int node_column = 0;
+
+#define YYLLOC_DEFAULT(Current, Rhs, N) \
+	do { \
+		if (N) { \
+			(Current).first_line = YYRHSLOC(Rhs, 1).first_line; \
+			(Current).first_column = YYRHSLOC(Rhs, 1).first_column; \
+			(Current).last_line = YYRHSLOC(Rhs, N).last_line; \
+			(Current).last_column = YYRHSLOC(Rhs, N).last_column; \
+		} else { \
+			(Current).first_line = (Current).last_line = YYRHSLOC(Rhs, 0).last_line; \
+			(Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+		} \
+		node_line = (Current).first_line; \
+		node_column = (Current).first_column; \
+	} while (0)
+
 extern int yylex();
 void yyerror(const char *s);
 
 %}
 
+%locations
+
 /* Represents the different ways to access our code being compiled*/
 
 %union {
@@ -29,12 +50,12 @@ void yyerror(const char *s);
 
 /* Terminal symbols. They need to match tokens in tokens.l file */
 
-%token <string> TIDENTIFIER TINTEGERLIT TDOUBLELIT TLONGLIT TBOOLLIT TSTRINGLIT
+%token <string> TIDENTIFIER TINTEGERLIT TDOUBLELIT TLONGLIT TBOOLLIT TSTRINGLIT TSIZEDLIT TFLOAT32LIT
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
 %token <token> TLPAREN TRPAREN TLBRACKET TRBRACKET TLBRACE TRBRACE TCOMMA TDOT TCOLON TSEMICOLON TFUNCTO
 %token <token> TPLUS TMINUS TMUL TDIV
 /* keywords */
-%token <token> TVAR TDEF TIF TELSE TFOR TRET TLAZY
+%token <token> TVAR TDEF TIF TELSE TFOR TRET TLAZY TSTRUCT TSOA TMAP TASYNC TAWAIT TSPAWN TCHAN
 
 /* Non Terminal symbols. Types refer to union decl above */
 %type <ident> ident
@@ -43,13 +64,14 @@ void yyerror(const char *s);
 %type <exprvec> call_args array
 %type <identvec> func_decl_func_arg
 %type <block> program stmts block
-%type <stmt> stmt var_decl func_decl_arg func_decl if_stmt for_stmt ret_stmt
+%type <stmt> stmt var_decl func_decl_arg func_decl struct_decl if_stmt for_stmt ret_stmt
 %type <token> comparison
 
 /* Operator precedence */
 %left TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
 %left TPLUS TMINUS
 %left TMUL TDIV
+%right TAWAIT
 
 /* Starting rule in the grammar*/
 
@@ -66,7 +88,7 @@ stmts: { $$ = new NBlock();  }
 	| stmts stmt { $1->statements.push_back($<stmt>2); }
 	;
 
-stmt: var_decl | func_decl
+stmt: var_decl | func_decl | struct_decl
 	| expr { $$ = new NExpressionStatement(*$1); }
 	| ret_stmt
 	| if_stmt
@@ -80,16 +102,30 @@ block: TLBRACE stmts TRBRACE { $$ = $2; }
 var_decl: TVAR ident TCOLON ident { $$ = new NVariableDeclaration(*$4, *$2); }
 		| TVAR ident TCOLON TLBRACKET TINTEGERLIT TRBRACKET ident { $$ = new NVariableDeclaration(*$7, *$2, atoi($5->c_str())); }
 		| TVAR ident TCOLON TLBRACKET TINTEGERLIT TRBRACKET ident TEQUAL array { $$ = new NVariableDeclaration(*$7, *$2, atoi($5->c_str()), *$9); }
+		| TVAR ident TCOLON TSOA TLBRACKET TINTEGERLIT TRBRACKET ident
+			{ auto decl = new NVariableDeclaration(*$8, *$2, atoi($6->c_str())); decl->soa = true; $$ = decl; }
+		| TVAR ident TCOLON TMAP TLBRACKET ident TRBRACKET ident
+			{ (*$8).name = "map[" + (*$6).name + "]" + (*$8).name; $$ = new NVariableDeclaration(*$8, *$2); }
+		| TVAR ident TCOLON TCHAN TLBRACKET ident TRBRACKET
+			{ (*$6).name = "chan[" + (*$6).name + "]"; $$ = new NVariableDeclaration(*$6, *$2); }
+		| TVAR ident TCOLON TCHAN TLBRACKET ident TCOMMA TINTEGERLIT TRBRACKET
+			{ (*$6).name = "chan[" + (*$6).name + "]"; auto decl = new NVariableDeclaration(*$6, *$2); decl->capacity = atoi($8->c_str()); $$ = decl; }
 		| TVAR ident TCOLON ident TEQUAL expr { $$ = new NVariableDeclaration(*$4, *$2, $6); }
 		| TVAR ident TEQUAL expr { auto type = new NIdentifier(""); $$ = new NVariableDeclaration(*type, *$2, $4); }
 		;
 
 func_decl: TDEF ident TLPAREN func_decl_args TRPAREN TCOLON ident block
 			{ $$ = new NFunctionDeclaration(*$7, *$2, *$4, *$8); delete $4; }
+		| TASYNC TDEF ident TLPAREN func_decl_args TRPAREN TCOLON ident block
+			{ auto decl = new NFunctionDeclaration(*$8, *$3, *$5, *$9); decl->isAsync = true; $$ = decl; delete $5; }
 		| TLPAREN func_decl_args TRPAREN TCOLON ident TFUNCTO block
 			{ auto id = new NIdentifier("anonymous"); $$ = new NFunctionDeclaration(*$5, *id, *$2, *$7); delete $2; }
 		;
 
+struct_decl: TSTRUCT ident TLBRACE func_decl_args TRBRACE
+			{ $$ = new NStructDeclaration(*$2, *$4); delete $4; }
+		;
+
 func_decl_func_arg:  { $$ = new IdentifierList(); }
 			| ident { $$ = new IdentifierList(); $$->push_back($<ident>1); }
 			| func_decl_func_arg TCOMMA ident { $1->push_back($<ident>3); }
@@ -98,6 +134,10 @@ func_decl_func_arg:  { $$ = new IdentifierList(); }
 func_decl_arg: ident TCOLON ident { $$ = new NVariableDeclaration(*$3, *$1); }
 			| ident TCOLON ident TEQUAL expr { /* default parameter */ $$ = new NVariableDeclaration(*$3, *$1, $5); }
 			| ident TCOLON TLBRACKET TRBRACKET ident { (*$5).name =  "[]" + (*$5).name; $$ = new NVariableDeclaration(*$5, *$1); }
+			| ident TCOLON TMAP TLBRACKET ident TRBRACKET ident
+					{ (*$7).name = "map[" + (*$5).name + "]" + (*$7).name; $$ = new NVariableDeclaration(*$7, *$1); }
+			| ident TCOLON TCHAN TLBRACKET ident TRBRACKET
+					{ (*$5).name = "chan[" + (*$5).name + "]"; $$ = new NVariableDeclaration(*$5, *$1); }
 			| ident TCOLON TLPAREN func_decl_func_arg TRPAREN TFUNCTO ident
 					{ auto type = new NIdentifier("func"); $$ = new NVariableDeclaration(*type, *$7, *$4, *$1); }
 			;
@@ -119,12 +159,16 @@ for_stmt: TFOR expr TSEMICOLON expr TSEMICOLON expr block {$$ = new NForStatemen
 
 ident: TIDENTIFIER { $$ = new NIdentifier(*$1); delete $1; }
 	| TIDENTIFIER TLBRACKET expr TRBRACKET { $$ = new NIdentifier(*$1, $3); delete $1; }
+	| TIDENTIFIER TDOT TIDENTIFIER { $$ = new NIdentifier(*$1); $$->field = *$3; delete $1; delete $3; }
+	| TIDENTIFIER TLBRACKET expr TRBRACKET TDOT TIDENTIFIER { $$ = new NIdentifier(*$1, $3); $$->field = *$6; delete $1; delete $6; }
 	| TLAZY TIDENTIFIER { $$ = new NIdentifier(*$2); $$->lazy = true; delete $2; }
 	;
 
 numeric: TINTEGERLIT { $$ = new NInteger(atoi($1->c_str())); delete $1; }
 	| TLONGLIT {$$ = new NLong(atol($1->c_str())); delete $1; }
 	| TDOUBLELIT { $$ = new NDouble(atof($1->c_str())); delete $1; }
+	| TSIZEDLIT { auto suffix = $1->find_first_of("iu"); $$ = new NSizedInteger(strtoull($1->c_str(), NULL, 10), $1->substr(suffix)); delete $1; }
+	| TFLOAT32LIT { $$ = new NFloat(atof($1->c_str())); delete $1; }
 	;
 
 boolean: TBOOLLIT {$$ = new NBoolean($1->c_str()[0] == 't'); delete $1; }
@@ -138,12 +182,14 @@ array: TLBRACE call_args TRBRACE { $$ = $2; }
 
 expr: ident TEQUAL expr { $$ = new NAssignment(*$<ident>1, *$3); }
 	| ident TLPAREN call_args TRPAREN { $$ = new NMethodCall(*$1, *$3); delete $3; }
+	| TSPAWN ident TLPAREN call_args TRPAREN { auto call = new NMethodCall(*$2, *$4); call->spawn = true; $$ = call; delete $4; }
 	| expr TPLUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
 	| expr TMINUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
 	| expr TMUL expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
 	| expr TDIV expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
 	| expr comparison expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
 	| TMINUS expr {$$ = new NUnaryOperator($1, *$2); }
+	| TAWAIT expr { $$ = new NAwait(*$2); }
 	| TLPAREN expr TRPAREN { $$ = $2; }
 	| ident { $<ident>$ = $1; }
 	| numeric
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+#include "ast.h"
+#include "reach.h"
+
+using namespace std;
+
+/**
+ * Reachability of functions on the AST, before any IR exists.
+ *
+ * The top level statements are the roots. Every name reachable code
+ * mentions, called or as a plain identifier (a function handed to sort,
+ * stored in a func variable or spawned), makes the functions declared under
+ * that name reachable in turn. Anonymous functions and functions declared
+ * inside an expression belong to the code around them. Names are not
+ * resolved by scope: a local that shadows a function keeps the function,
+ * so the pass only ever errs on the side of generating.
+ */
+namespace {
+
+/* Nodes right below node, NULL entries included */
+void children(Node* node, vector<Node*>& out) {
+	if (NIdentifier* identifier = dynamic_cast<NIdentifier*>(node)) {
+		out.push_back(identifier->index);
+	} else if (NMethodCall* call = dynamic_cast<NMethodCall*>(node)) {
+		out.insert(out.end(), call->arguments.begin(), call->arguments.end());
+	} else if (NUnaryOperator* unary = dynamic_cast<NUnaryOperator*>(node)) {
+		out.push_back(&unary->rightSide);
+	} else if (NAwait* await = dynamic_cast<NAwait*>(node)) {
+		out.push_back(&await->task);
+	} else if (NBinaryOperator* binary = dynamic_cast<NBinaryOperator*>(node)) {
+		out.push_back(&binary->leftSide);
+		out.push_back(&binary->rightSide);
+	} else if (NBlock* block = dynamic_cast<NBlock*>(node)) {
+		out.insert(out.end(), block->statements.begin(), block->statements.end());
+	} else if (NAssignment* assignment = dynamic_cast<NAssignment*>(node)) {
+		out.push_back(&assignment->leftSide);
+		out.push_back(&assignment->rightSide);
+	} else if (NIfStatement* branch = dynamic_cast<NIfStatement*>(node)) {
+		out.push_back(&branch->condition);
+		out.push_back(&branch->thenBlock);
+		out.push_back(&branch->elseBlock);
+	} else if (NForStatement* loop = dynamic_cast<NForStatement*>(node)) {
+		out.push_back(loop->varDecl);
+		out.push_back(loop->start);
+		out.push_back(loop->end);
+		out.push_back(loop->step);
+		out.push_back(&loop->block);
+	} else if (NExpressionStatement* statement = dynamic_cast<NExpressionStatement*>(node)) {
+		out.push_back(&statement->expression);
+	} else if (NRet* ret = dynamic_cast<NRet*>(node)) {
+		out.push_back(&ret->expression);
+	} else if (NVariableDeclaration* variable = dynamic_cast<NVariableDeclaration*>(node)) {
+		out.push_back(variable->assignmentExpr);
+		out.insert(out.end(), variable->arrayValue.begin(), variable->arrayValue.end());
+	} else if (NFunctionDeclaration* function = dynamic_cast<NFunctionDeclaration*>(node)) {
+		// default parameters
+		out.insert(out.end(), function->arguments.begin(), function->arguments.end());
+		out.push_back(&function->block);
+	}
+}
+
+/* A function that only its name makes reachable: a named declaration among the statements of a block */
+bool declaredByName(Node* statement) {
+	NFunctionDeclaration* function = dynamic_cast<NFunctionDeclaration*>(statement);
+	return function && function->id.name != "anonymous";
+}
+
+class Reach {
+	multimap<string, NFunctionDeclaration*> functions;
+	set<string> mentioned;
+	vector<string> pending;
+
+	/* every function declared anywhere, reachable or not */
+	void collect(Node* node) {
+		if (NFunctionDeclaration* function = dynamic_cast<NFunctionDeclaration*>(node)) {
+			function->reachable = false;
+			functions.insert({ function->id.name, function });
+		}
+		vector<Node*> below;
+		children(node, below);
+		for (Node* child : below) {
+			if (child) {
+				collect(child);
+			}
+		}
+	}
+
+	void mention(const string& name) {
+		if (mentioned.insert(name).second) {
+			pending.push_back(name);
+		}
+	}
+
+	/* code that runs, the names it mentions are followed later */
+	void visit(Node* node) {
+		if (NIdentifier* identifier = dynamic_cast<NIdentifier*>(node)) {
+			mention(identifier->name);
+		} else if (NMethodCall* call = dynamic_cast<NMethodCall*>(node)) {
+			mention(call->id.name);
+		} else if (NFunctionDeclaration* function = dynamic_cast<NFunctionDeclaration*>(node)) {
+			if (function->reachable) {
+				return;
+			}
+			function->reachable = true;
+		}
+		vector<Node*> below;
+		children(node, below);
+		bool block = dynamic_cast<NBlock*>(node) != NULL;
+		for (Node* child : below) {
+			if (child && !(block && declaredByName(child))) {
+				visit(child);
+			}
+		}
+	}
+
+public:
+	void run(NBlock& program) {
+		collect(&program);
+		visit(&program);
+		while (!pending.empty()) {
+			string name = pending.back();
+			pending.pop_back();
+			auto range = functions.equal_range(name);
+			for (auto it = range.first; it != range.second; it++) {
+				visit(it->second);
+			}
+		}
+
+		for (auto& entry : functions) {
+			if (!entry.second->reachable) {
+				cout << "Skipping unreachable function " << entry.first << " (line " << entry.second->line << ")" << endl;
+			}
+		}
+	}
+};
+
+}
+
+void markReachable(NBlock& program) {
+	Reach().run(program);
+}
@@ -0,0 +1,234 @@
+/**
+ * Bulk array kernels behind the sum/min/max/find/sort builtins.
+ *
+ * Every kernel exists once per element type, named __coo_array_<op>_<type>
+ * with <type> one of i8 u8 i16 u16 i32 u32 i64 u64 f32 f64. Arrays come in
+ * as a pointer to the first element and an element count.
+ *
+ * Reductions keep eight independent accumulators, so the loops vectorize and
+ * float sums do not wait on a single add chain (the rounding therefore
+ * differs slightly from a left to right sum). Integers sort with an LSD
+ * radix sort, floats with an introsort.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COO_LANES 8
+#define COO_SMALL_SORT 64
+
+#define COO_SWAP(type, x, y) do { type swap_ = (x); (x) = (y); (y) = swap_; } while (0)
+
+static int coo_log2(int64_t n) {
+    int log = 0;
+    while (n > 1) {
+        n >>= 1;
+        log++;
+    }
+    return log;
+}
+
+#define COO_REDUCE(suffix, type) \
+type __coo_array_sum_##suffix(const type *a, int64_t n) { \
+    type lanes[COO_LANES] = {0}; \
+    int64_t i = 0; \
+    for (; i + COO_LANES <= n; i += COO_LANES) \
+        for (int k = 0; k < COO_LANES; k++) \
+            lanes[k] += a[i + k]; \
+    type sum = 0; \
+    for (int k = 0; k < COO_LANES; k++) \
+        sum += lanes[k]; \
+    for (; i < n; i++) \
+        sum += a[i]; \
+    return sum; \
+} \
+\
+type __coo_array_min_##suffix(const type *a, int64_t n) { \
+    if (n <= 0) \
+        return 0; \
+    type lanes[COO_LANES]; \
+    for (int k = 0; k < COO_LANES; k++) \
+        lanes[k] = a[0]; \
+    int64_t i = 0; \
+    for (; i + COO_LANES <= n; i += COO_LANES) \
+        for (int k = 0; k < COO_LANES; k++) \
+            lanes[k] = a[i + k] < lanes[k] ? a[i + k] : lanes[k]; \
+    type min = lanes[0]; \
+    for (int k = 1; k < COO_LANES; k++) \
+        min = lanes[k] < min ? lanes[k] : min; \
+    for (; i < n; i++) \
+        min = a[i] < min ? a[i] : min; \
+    return min; \
+} \
+\
+type __coo_array_max_##suffix(const type *a, int64_t n) { \
+    if (n <= 0) \
+        return 0; \
+    type lanes[COO_LANES]; \
+    for (int k = 0; k < COO_LANES; k++) \
+        lanes[k] = a[0]; \
+    int64_t i = 0; \
+    for (; i + COO_LANES <= n; i += COO_LANES) \
+        for (int k = 0; k < COO_LANES; k++) \
+            lanes[k] = a[i + k] > lanes[k] ? a[i + k] : lanes[k]; \
+    type max = lanes[0]; \
+    for (int k = 1; k < COO_LANES; k++) \
+        max = lanes[k] > max ? lanes[k] : max; \
+    for (; i < n; i++) \
+        max = a[i] > max ? a[i] : max; \
+    return max; \
+} \
+\
+/* index of the first element equal to v, -1 if there is none */ \
+int32_t __coo_array_find_##suffix(const type *a, int64_t n, type v) { \
+    int64_t i = 0; \
+    for (; i + COO_LANES <= n; i += COO_LANES) { \
+        int hit = 0; \
+        for (int k = 0; k < COO_LANES; k++) \
+            hit |= a[i + k] == v; \
+        if (hit) \
+            break; \
+    } \
+    for (; i < n; i++) \
+        if (a[i] == v) \
+            return (int32_t)i; \
+    return -1; \
+}
+
+/* comparison sorts: insertion sort for short runs, heapsort once quicksort degenerates */
+#define COO_INTROSORT(suffix, type) \
+static void coo_insertion_##suffix(type *a, int64_t n) { \
+    for (int64_t i = 1; i < n; i++) { \
+        type x = a[i]; \
+        int64_t j = i; \
+        for (; j > 0 && x < a[j - 1]; j--) \
+            a[j] = a[j - 1]; \
+        a[j] = x; \
+    } \
+} \
+\
+static void coo_sift_##suffix(type *a, int64_t root, int64_t end) { \
+    for (;;) { \
+        int64_t child = 2 * root + 1; \
+        if (child >= end) \
+            return; \
+        if (child + 1 < end && a[child] < a[child + 1]) \
+            child++; \
+        if (!(a[root] < a[child])) \
+            return; \
+        COO_SWAP(type, a[root], a[child]); \
+        root = child; \
+    } \
+} \
+\
+static void coo_heapsort_##suffix(type *a, int64_t n) { \
+    for (int64_t i = n / 2 - 1; i >= 0; i--) \
+        coo_sift_##suffix(a, i, n); \
+    for (int64_t end = n - 1; end > 0; end--) { \
+        COO_SWAP(type, a[0], a[end]); \
+        coo_sift_##suffix(a, 0, end); \
+    } \
+} \
+\
+static void coo_introsort_##suffix(type *a, int64_t n, int depth) { \
+    while (n > 16) { \
+        if (depth-- == 0) { \
+            coo_heapsort_##suffix(a, n); \
+            return; \
+        } \
+        /* median of three, a[0] <= a[mid] <= a[n - 1] */ \
+        int64_t mid = (n - 1) / 2; \
+        if (a[mid] < a[0]) \
+            COO_SWAP(type, a[mid], a[0]); \
+        if (a[n - 1] < a[mid]) { \
+            COO_SWAP(type, a[n - 1], a[mid]); \
+            if (a[mid] < a[0]) \
+                COO_SWAP(type, a[mid], a[0]); \
+        } \
+        type pivot = a[mid]; \
+        int64_t i = -1, j = n; \
+        for (;;) { \
+            do i++; while (a[i] < pivot); \
+            do j--; while (pivot < a[j]); \
+            if (i >= j) \
+                break; \
+            COO_SWAP(type, a[i], a[j]); \
+        } \
+        /* recurse into the smaller half, loop on the larger one */ \
+        if (j + 1 < n - j - 1) { \
+            coo_introsort_##suffix(a, j + 1, depth); \
+            a += j + 1; \
+            n -= j + 1; \
+        } else { \
+            coo_introsort_##suffix(a + j + 1, n - j - 1, depth); \
+            n = j + 1; \
+        } \
+    } \
+    coo_insertion_##suffix(a, n); \
+}
+
+#define COO_SORT_FLOAT(suffix, type) \
+COO_INTROSORT(suffix, type) \
+void __coo_array_sort_##suffix(type *a, int64_t n) { \
+    if (n > 1) \
+        coo_introsort_##suffix(a, n, 2 * coo_log2(n)); \
+}
+
+/**
+ * LSD radix sort, one byte per pass on the bits of the element with the sign
+ * bit flipped (flip) so that signed keys order as unsigned ones. A pass in
+ * which every key has the same byte moves nothing and is skipped.
+ */
+#define COO_SORT_INT(suffix, type, utype, flip) \
+COO_INTROSORT(suffix, type) \
+void __coo_array_sort_##suffix(type *a, int64_t n) { \
+    if (n < COO_SMALL_SORT) { \
+        coo_insertion_##suffix(a, n); \
+        return; \
+    } \
+    utype *buffer = malloc(n * sizeof(utype)); \
+    if (buffer == NULL) { \
+        coo_introsort_##suffix(a, n, 2 * coo_log2(n)); \
+        return; \
+    } \
+    utype *from = (utype *)a, *to = buffer; \
+    for (unsigned shift = 0; shift < 8 * sizeof(utype); shift += 8) { \
+        int64_t count[257] = {0}; \
+        for (int64_t i = 0; i < n; i++) \
+            count[((utype)(from[i] ^ (flip)) >> shift & 0xff) + 1]++; \
+        if (count[((utype)(from[0] ^ (flip)) >> shift & 0xff) + 1] == n) \
+            continue; \
+        for (int digit = 0; digit < 256; digit++) \
+            count[digit + 1] += count[digit]; \
+        for (int64_t i = 0; i < n; i++) \
+            to[count[(utype)(from[i] ^ (flip)) >> shift & 0xff]++] = from[i]; \
+        utype *sorted = to; \
+        to = from; \
+        from = sorted; \
+    } \
+    if (from != (utype *)a) \
+        memcpy(a, from, n * sizeof(utype)); \
+    free(buffer); \
+}
+
+COO_REDUCE(i8, int8_t)
+COO_REDUCE(u8, uint8_t)
+COO_REDUCE(i16, int16_t)
+COO_REDUCE(u16, uint16_t)
+COO_REDUCE(i32, int32_t)
+COO_REDUCE(u32, uint32_t)
+COO_REDUCE(i64, int64_t)
+COO_REDUCE(u64, uint64_t)
+COO_REDUCE(f32, float)
+COO_REDUCE(f64, double)
+
+COO_SORT_INT(i8, int8_t, uint8_t, 0x80)
+COO_SORT_INT(u8, uint8_t, uint8_t, 0)
+COO_SORT_INT(i16, int16_t, uint16_t, 0x8000)
+COO_SORT_INT(u16, uint16_t, uint16_t, 0)
+COO_SORT_INT(i32, int32_t, uint32_t, 0x80000000u)
+COO_SORT_INT(u32, uint32_t, uint32_t, 0)
+COO_SORT_INT(i64, int64_t, uint64_t, 0x8000000000000000ull)
+COO_SORT_INT(u64, uint64_t, uint64_t, 0)
+COO_SORT_FLOAT(f32, float)
+COO_SORT_FLOAT(f64, double)
@@ -0,0 +1,331 @@
+/**
+ * Channels and the worker pool behind chan[T] and spawn f(args).
+ *
+ * A channel is a bounded ring of 64 bit slots (filled by the compiler like
+ * map slots) in the layout of Vyukov's MPMC queue: every cell carries a
+ * sequence number telling whether it is free for the sender at position
+ * pos (seq == pos) or holds the value for the receiver at pos (seq == pos + 1).
+ * Senders and receivers claim positions with one compare and swap on their
+ * own counter, so no message takes a lock.
+ *
+ * Only a side that has to wait, for room or for data, goes to sleep on a
+ * futex (an eventcount shared by both sides). After every operation the
+ * other side is woken only when somebody is known to sleep, which costs
+ * a fence and a load while the channel flows.
+ *
+ * close(c) sets the top bit of the sender counter, so every send either
+ * took its position before the close or fails; recv keeps returning what
+ * is left, waits for sends still filling their cell, and fails once the
+ * channel is closed and empty.
+ *
+ * spawn hands a job to a pool of detached threads through a channel of its
+ * own. The pool starts with one worker per core and grows up to
+ * COO_MAX_WORKERS while every worker is busy: each spawn claims an idle
+ * worker, or starts a new one, so a job only waits behind another once the
+ * pool is at its limit. Jobs that block on channels
+ * hold on to their thread, a pipeline needs a worker per blocking stage.
+ * When the queue is full the job runs on the spawning thread.
+ * join() waits until every spawned job has returned.
+ */
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define COO_SPIN 128
+#define COO_JOBS 4096
+#define COO_MAX_WORKERS 256
+#define COO_CLOSED (1ull << 63)
+
+/* sleeping waiters of a condition: take a key, recheck the condition, then wait on the key */
+typedef struct coo_event {
+    _Atomic uint32_t epoch;
+    _Atomic int32_t waiters;
+} coo_event;
+
+static uint32_t coo_event_prepare(coo_event *e) {
+    atomic_fetch_add(&e->waiters, 1);
+    return atomic_load(&e->epoch);
+}
+
+static void coo_event_cancel(coo_event *e) {
+    atomic_fetch_sub(&e->waiters, 1);
+}
+
+static void coo_event_wait(coo_event *e, uint32_t key) {
+    syscall(SYS_futex, &e->epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+    atomic_fetch_sub(&e->waiters, 1);
+}
+
+static void coo_event_notify(coo_event *e) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&e->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&e->epoch, 1);
+        syscall(SYS_futex, &e->epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+static inline void coo_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+typedef struct coo_cell {
+    _Atomic uint64_t seq;
+    uint64_t value;
+} coo_cell;
+
+typedef struct coo_chan {
+    /* senders and receivers each get a cache line of their own */
+    _Alignas(64) _Atomic uint64_t tail;  /* COO_CLOSED once closed */
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) coo_event event;
+    uint64_t mask;
+    coo_cell *cells;
+} coo_chan;
+
+/* 1 once value is in, 0 when full, -1 when closed */
+static int coo_chan_push(coo_chan *c, uint64_t value) {
+    uint64_t pos = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    for (;;) {
+        if (pos & COO_CLOSED)
+            return -1;
+        coo_cell *cell = &c->cells[pos & c->mask];
+        int64_t diff = (int64_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&c->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                cell->value = value;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;  /* full, the cell still holds the value from a lap ago */
+        } else {
+            pos = atomic_load_explicit(&c->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static int coo_chan_pop(coo_chan *c, uint64_t *value) {
+    uint64_t pos = atomic_load_explicit(&c->head, memory_order_relaxed);
+    for (;;) {
+        coo_cell *cell = &c->cells[pos & c->mask];
+        int64_t diff = (int64_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&c->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *value = cell->value;
+                atomic_store_explicit(&cell->seq, pos + c->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;  /* empty */
+        } else {
+            pos = atomic_load_explicit(&c->head, memory_order_relaxed);
+        }
+    }
+}
+
+/* closed, and every value sent before the close has been received */
+static int coo_chan_drained(coo_chan *c) {
+    uint64_t tail = atomic_load(&c->tail);
+    return (tail & COO_CLOSED) && atomic_load(&c->head) >= (tail & ~COO_CLOSED);
+}
+
+/* a channel of at least capacity slots, rounded up to a power of two */
+coo_chan *__coo_chan_new(int64_t capacity) {
+    uint64_t slots = 2;
+    while (slots < (uint64_t)capacity)
+        slots *= 2;
+    coo_chan *c = aligned_alloc(64, sizeof(coo_chan));
+    c->cells = malloc(slots * sizeof(coo_cell));
+    for (uint64_t i = 0; i < slots; i++)
+        atomic_init(&c->cells[i].seq, i);
+    c->mask = slots - 1;
+    atomic_init(&c->tail, 0);
+    atomic_init(&c->head, 0);
+    atomic_init(&c->event.epoch, 0);
+    atomic_init(&c->event.waiters, 0);
+    return c;
+}
+
+/* 1 once value is in the channel, 0 if it is closed */
+int32_t __coo_chan_send(coo_chan *c, uint64_t value) {
+    for (int spin = 0;; spin++) {
+        int pushed = coo_chan_push(c, value);
+        if (pushed > 0) {
+            coo_event_notify(&c->event);
+            return 1;
+        }
+        if (pushed < 0)
+            return 0;
+        if (spin < COO_SPIN) {
+            coo_pause();
+            continue;
+        }
+        uint32_t key = coo_event_prepare(&c->event);
+        pushed = coo_chan_push(c, value);
+        if (pushed != 0) {
+            coo_event_cancel(&c->event);
+            if (pushed > 0)
+                coo_event_notify(&c->event);
+            return pushed > 0;
+        }
+        coo_event_wait(&c->event, key);
+    }
+}
+
+/* 1 with the next value in *value, 0 once the channel is closed and empty */
+int32_t __coo_chan_recv(coo_chan *c, uint64_t *value) {
+    for (int spin = 0;; spin++) {
+        if (coo_chan_pop(c, value)) {
+            coo_event_notify(&c->event);
+            return 1;
+        }
+        if (coo_chan_drained(c))
+            return 0;
+        if (spin < COO_SPIN) {
+            coo_pause();
+            continue;
+        }
+        uint32_t key = coo_event_prepare(&c->event);
+        if (coo_chan_pop(c, value)) {
+            coo_event_cancel(&c->event);
+            coo_event_notify(&c->event);
+            return 1;
+        }
+        if (coo_chan_drained(c)) {
+            coo_event_cancel(&c->event);
+            return 0;
+        }
+        coo_event_wait(&c->event, key);
+    }
+}
+
+/* recv without waiting, 0 when there is nothing to receive right now */
+int32_t __coo_chan_try_recv(coo_chan *c, uint64_t *value) {
+    if (!coo_chan_pop(c, value))
+        return 0;
+    coo_event_notify(&c->event);
+    return 1;
+}
+
+void __coo_chan_close(coo_chan *c) {
+    atomic_fetch_or(&c->tail, COO_CLOSED);
+    atomic_fetch_add(&c->event.epoch, 1);
+    syscall(SYS_futex, &c->event.epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* values waiting in the channel, a snapshot while others send and receive */
+int64_t __coo_chan_len(coo_chan *c) {
+    int64_t n = (int64_t)((atomic_load(&c->tail) & ~COO_CLOSED) - atomic_load(&c->head));
+    return n < 0 ? 0 : n;
+}
+
+typedef struct coo_job {
+    void (*run)(void *);
+    void *record;
+} coo_job;
+
+static struct {
+    coo_chan *jobs;
+    _Atomic int32_t workers;
+    _Atomic int32_t idle;     /* waiting workers no spawn has claimed yet */
+    _Atomic int64_t pending;
+    coo_event done;
+    int32_t max_workers;
+} coo_pool;
+
+static pthread_once_t coo_pool_once = PTHREAD_ONCE_INIT;
+
+static void coo_job_finish(void) {
+    if (atomic_fetch_sub(&coo_pool.pending, 1) == 1)
+        coo_event_notify(&coo_pool.done);
+}
+
+/* a worker starts out claimed: by the spawn that started it, or counted idle by the pool start */
+static void *coo_worker(void *unused) {
+    (void)unused;
+    for (;;) {
+        uint64_t bits;
+        __coo_chan_recv(coo_pool.jobs, &bits);
+        coo_job *job = (coo_job *)(uintptr_t)bits;
+        job->run(job->record);
+        free(job);
+        coo_job_finish();
+        atomic_fetch_add(&coo_pool.idle, 1);
+    }
+    return NULL;
+}
+
+/* one more worker unless the pool is at its limit, 0 if none was started */
+static int coo_pool_grow(void) {
+    int32_t workers = atomic_load(&coo_pool.workers);
+    do {
+        if (workers >= coo_pool.max_workers)
+            return 0;
+    } while (!atomic_compare_exchange_weak(&coo_pool.workers, &workers, workers + 1));
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, coo_worker, NULL) != 0) {
+        atomic_fetch_sub(&coo_pool.workers, 1);
+        return 0;
+    }
+    pthread_detach(thread);
+    return 1;
+}
+
+static void coo_pool_start(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    coo_pool.jobs = __coo_chan_new(COO_JOBS);
+    coo_pool.max_workers = COO_MAX_WORKERS;
+    for (long i = 0; i < (cores > 0 ? cores : 1); i++)
+        atomic_fetch_add(&coo_pool.idle, coo_pool_grow());
+}
+
+/* take one idle worker for a job, 0 if every worker has one already */
+static int coo_pool_claim(void) {
+    int32_t idle = atomic_load(&coo_pool.idle);
+    do {
+        if (idle == 0)
+            return 0;
+    } while (!atomic_compare_exchange_weak(&coo_pool.idle, &idle, idle - 1));
+    return 1;
+}
+
+/* run(record) on a worker, the generated trampoline run frees record */
+void __coo_spawn(void (*run)(void *), void *record) {
+    pthread_once(&coo_pool_once, coo_pool_start);
+    atomic_fetch_add(&coo_pool.pending, 1);
+    // at the limit the job is queued unclaimed, for the next worker that is done
+    int claimed = coo_pool_claim() || coo_pool_grow();
+
+    coo_job *job = malloc(sizeof(coo_job));
+    job->run = run;
+    job->record = record;
+    if (coo_chan_push(coo_pool.jobs, (uint64_t)(uintptr_t)job)) {
+        coo_event_notify(&coo_pool.jobs->event);
+        return;
+    }
+    // the claimed worker has no job after all
+    if (claimed)
+        atomic_fetch_add(&coo_pool.idle, 1);
+    free(job);
+    run(record);
+    coo_job_finish();
+}
+
+/* wait for every spawned job, the ones they spawn included */
+void __coo_join(void) {
+    while (atomic_load(&coo_pool.pending) > 0) {
+        uint32_t key = coo_event_prepare(&coo_pool.done);
+        if (atomic_load(&coo_pool.pending) == 0) {
+            coo_event_cancel(&coo_pool.done);
+            break;
+        }
+        coo_event_wait(&coo_pool.done, key);
+    }
+}
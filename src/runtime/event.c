@@ -0,0 +1,272 @@
+/**
+ * Tasks and the event loop behind async/await.
+ *
+ * An async function is an LLVM coroutine. Calling it runs the body up to
+ * its first suspension and hands back its task; the coroutine frame lives
+ * on the heap and is all a waiting task costs. Leaf tasks have no frame:
+ * sleep(ms) completes from the timer heap and read(fd, buf, n) from epoll.
+ *
+ * await on an unfinished task records the awaiting task as its waiter and
+ * suspends. A task that finishes queues its waiter, and the loop resumes
+ * queued tasks one at a time on its own stack, so a chain of awaits never
+ * nests resumptions. Outside of async functions await runs the loop until
+ * the task is done. One task can be awaited once, which also frees it. A
+ * call whose task is thrown away detaches it, and the task frees itself
+ * when it is done.
+ *
+ * Everything runs on one thread; the loop blocks in epoll_wait only when
+ * no task is ready, for as long as the nearest timer allows.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct coo_task {
+    void *frame;             /* coroutine handle, NULL for leaf tasks */
+    struct coo_task *waiter; /* suspended in await on this task */
+    struct coo_task *next;   /* run queue link */
+    int64_t result;
+    int32_t done;
+    int32_t detached;        /* nobody will await it */
+    /* leaf tasks */
+    int64_t deadline;
+    int32_t fd;
+    void *buffer;
+    int64_t length;
+} coo_task;
+
+static struct {
+    coo_task *head, *tail;   /* tasks ready to be resumed */
+    coo_task **timers;       /* binary min-heap on deadline */
+    int64_t timer_count, timer_capacity;
+    int epoll_fd;
+    int64_t reads;           /* reads waiting in epoll */
+} coo_loop = { NULL, NULL, NULL, 0, 0, -1, 0 };
+
+static int64_t coo_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static coo_task *coo_task_alloc(void *frame) {
+    coo_task *task = calloc(1, sizeof(coo_task));
+    task->frame = frame;
+    task->fd = -1;
+    return task;
+}
+
+static void coo_schedule(coo_task *task) {
+    task->next = NULL;
+    if (coo_loop.tail)
+        coo_loop.tail->next = task;
+    else
+        coo_loop.head = task;
+    coo_loop.tail = task;
+}
+
+/* the first two words of a switched-resume frame are its resume and destroy functions */
+static void coo_resume(coo_task *task) {
+    (*(void (**)(void *))task->frame)(task->frame);
+}
+
+static void coo_destroy(coo_task *task) {
+    ((void (**)(void *))task->frame)[1](task->frame);
+}
+
+/* free a finished task, a frame is at its final suspend by then */
+static void coo_release(coo_task *task) {
+    if (task->frame)
+        coo_destroy(task);
+    free(task);
+}
+
+/**
+ * mark task done and wake whoever awaits it. A detached leaf task goes right
+ * away; a detached async function is still running its body here, the loop
+ * frees it once the resume returns.
+ */
+static void coo_complete(coo_task *task, int64_t result) {
+    task->result = result;
+    task->done = 1;
+    if (task->waiter)
+        coo_schedule(task->waiter);
+    else if (task->detached && !task->frame)
+        coo_release(task);
+}
+
+static void coo_timer_push(coo_task *task) {
+    if (coo_loop.timer_count == coo_loop.timer_capacity) {
+        coo_loop.timer_capacity = coo_loop.timer_capacity ? 2 * coo_loop.timer_capacity : 16;
+        coo_loop.timers = realloc(coo_loop.timers, coo_loop.timer_capacity * sizeof(coo_task *));
+    }
+    int64_t i = coo_loop.timer_count++;
+    for (; i > 0 && coo_loop.timers[(i - 1) / 2]->deadline > task->deadline; i = (i - 1) / 2)
+        coo_loop.timers[i] = coo_loop.timers[(i - 1) / 2];
+    coo_loop.timers[i] = task;
+}
+
+static coo_task *coo_timer_pop(void) {
+    coo_task *top = coo_loop.timers[0];
+    coo_task *last = coo_loop.timers[--coo_loop.timer_count];
+    int64_t i = 0;
+    for (;;) {
+        int64_t child = 2 * i + 1;
+        if (child >= coo_loop.timer_count)
+            break;
+        if (child + 1 < coo_loop.timer_count && coo_loop.timers[child + 1]->deadline < coo_loop.timers[child]->deadline)
+            child++;
+        if (last->deadline <= coo_loop.timers[child]->deadline)
+            break;
+        coo_loop.timers[i] = coo_loop.timers[child];
+        i = child;
+    }
+    if (coo_loop.timer_count > 0)
+        coo_loop.timers[i] = last;
+    return top;
+}
+
+/* resume the ready tasks, then wait for the next timer or read; 0 once there is nothing left to do */
+static int coo_loop_step(void) {
+    if (coo_loop.head) {
+        while (coo_loop.head) {
+            coo_task *task = coo_loop.head;
+            coo_loop.head = task->next;
+            if (!coo_loop.head)
+                coo_loop.tail = NULL;
+            coo_resume(task);
+            if (task->detached && task->done)
+                coo_release(task);
+        }
+        return 1;
+    }
+    if (coo_loop.timer_count == 0 && coo_loop.reads == 0)
+        return 0;
+
+    int timeout = -1;
+    if (coo_loop.timer_count > 0) {
+        int64_t wait = coo_loop.timers[0]->deadline - coo_now_ms();
+        timeout = wait < 0 ? 0 : wait > INT32_MAX ? INT32_MAX : (int)wait;
+    }
+    if (coo_loop.reads > 0) {
+        struct epoll_event events[64];
+        int n = epoll_wait(coo_loop.epoll_fd, events, 64, timeout);
+        for (int i = 0; i < n; i++) {
+            coo_task *task = events[i].data.ptr;
+            epoll_ctl(coo_loop.epoll_fd, EPOLL_CTL_DEL, task->fd, NULL);
+            coo_loop.reads--;
+            ssize_t got = read(task->fd, task->buffer, task->length);
+            coo_complete(task, got < 0 ? -1 : got);
+        }
+    } else if (timeout > 0) {
+        struct timespec pause = { timeout / 1000, (long)(timeout % 1000) * 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    int64_t now = coo_now_ms();
+    while (coo_loop.timer_count > 0 && coo_loop.timers[0]->deadline <= now)
+        coo_complete(coo_timer_pop(), 0);
+    return 1;
+}
+
+/* called by an async function right after coro.begin */
+coo_task *__coo_task_new(void *frame) {
+    return coo_task_alloc(frame);
+}
+
+/* called by an async function on its way to the final suspend */
+void __coo_task_return(coo_task *task, int64_t result) {
+    coo_complete(task, result);
+}
+
+/* await inside an async function: 1 when task is done, else self waits for it and must suspend */
+int32_t __coo_task_await(coo_task *self, coo_task *task) {
+    if (task->done)
+        return 1;
+    if (task->waiter) {
+        fprintf(stderr, "a task can only be awaited once\n");
+        exit(1);
+    }
+    task->waiter = self;
+    return 0;
+}
+
+/* await outside of async functions: run the loop until task is done */
+void __coo_task_wait(coo_task *task) {
+    while (!task->done) {
+        if (!coo_loop_step()) {
+            fprintf(stderr, "await on a task that can never finish\n");
+            exit(1);
+        }
+    }
+}
+
+/* result of a finished task, its frame and the task itself are freed */
+int64_t __coo_task_result(coo_task *task) {
+    int64_t result = task->result;
+    coo_release(task);
+    return result;
+}
+
+/* the task of a call used as a statement: free it now if done, else when it is */
+void __coo_task_detach(coo_task *task) {
+    if (task->done)
+        coo_release(task);
+    else
+        task->detached = 1;
+}
+
+/* run(): drive the loop until every task that can still finish has */
+void __coo_async_run(void) {
+    while (coo_loop_step())
+        ;
+}
+
+coo_task *__coo_async_sleep(int64_t ms) {
+    coo_task *task = coo_task_alloc(NULL);
+    task->deadline = coo_now_ms() + (ms > 0 ? ms : 0);
+    coo_timer_push(task);
+    return task;
+}
+
+/**
+ * read up to length bytes of fd, done right away for files and for pipes
+ * with data waiting. The fd keeps its flags (it may be shared with open("-")
+ * or other processes): poll tells whether a read would block, and a read
+ * is only made once the fd is readable, so a blocking fd never blocks.
+ */
+coo_task *__coo_async_read(int32_t fd, void *buffer, int64_t length) {
+    coo_task *task = coo_task_alloc(NULL);
+    struct pollfd ready = { fd, POLLIN, 0 };
+    int polled;
+    while ((polled = poll(&ready, 1, 0)) < 0 && errno == EINTR)
+        ;
+    if (polled != 0) {
+        ssize_t got = polled > 0 ? read(fd, buffer, length) : -1;
+        if (got >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            coo_complete(task, got < 0 ? -1 : got);
+            return task;
+        }
+    }
+
+    if (coo_loop.epoll_fd < 0)
+        coo_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    task->fd = fd;
+    task->buffer = buffer;
+    task->length = length;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = task;
+    if (epoll_ctl(coo_loop.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        coo_complete(task, -1);
+        return task;
+    }
+    coo_loop.reads++;
+    return task;
+}
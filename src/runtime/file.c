@@ -0,0 +1,208 @@
+/**
+ * Input files behind open/line/record/read_int/read_float and the number
+ * parsers for views.
+ *
+ * A regular file is mapped whole with mmap and read through a cursor;
+ * madvise(MADV_SEQUENTIAL) lets the kernel read ahead and drop pages
+ * behind it. Lines and records come back as views (a pointer and a length)
+ * straight into the mapping, nothing is copied until string(v).
+ *
+ * Pipes, terminals and "-" (standard input) cannot be mapped, they are read
+ * in COO_CHUNK pieces into a buffer that only keeps the unread part. The
+ * views of such a file stay valid until the next read from it.
+ *
+ * Reading past the end returns an empty view or 0 and sets eof(f), which
+ * therefore turns true only after the last line or number was consumed.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define COO_CHUNK (1 << 20)
+#define COO_NUMBER 64
+
+typedef struct coo_file {
+    const char *data;     /* the mapping, or buffer for a stream */
+    int64_t size;         /* bytes in data */
+    int64_t pos;          /* cursor into data */
+    int fd;
+    int mapped;
+    int drained;          /* a stream hit its end, data holds all that is left */
+    int eof;
+    char *buffer;
+    int64_t capacity;
+} coo_file;
+
+/* make at least need unread bytes available, fewer only at the end of a stream */
+static void coo_file_fill(coo_file *f, int64_t need) {
+    if (f->mapped || f->drained || f->size - f->pos >= need)
+        return;
+    int64_t left = f->size - f->pos;
+    if (left > 0)
+        memmove(f->buffer, f->buffer + f->pos, left);
+    f->pos = 0;
+    f->size = left;
+    while (!f->drained && f->size < need) {
+        if (f->capacity - f->size < COO_CHUNK) {
+            f->capacity = 2 * f->capacity > f->size + COO_CHUNK ? 2 * f->capacity : f->size + COO_CHUNK;
+            f->buffer = realloc(f->buffer, f->capacity);
+        }
+        ssize_t got = read(f->fd, f->buffer + f->size, f->capacity - f->size);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            f->drained = 1;
+        else
+            f->size += got;
+    }
+    f->data = f->buffer;
+}
+
+coo_file *__coo_file_open(const char *path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    coo_file *f = calloc(1, sizeof(coo_file));
+    f->fd = fd;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        f->size = info.st_size;
+        if (f->size == 0) {
+            f->mapped = 1;
+            return f;
+        }
+        void *map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, f->size, MADV_SEQUENTIAL);
+            f->data = map;
+            f->mapped = 1;
+            return f;
+        }
+        f->size = 0;
+    }
+    return f;
+}
+
+void __coo_file_close(coo_file *f) {
+    if (f->mapped && f->size > 0)
+        munmap((void *)f->data, f->size);
+    if (f->fd != STDIN_FILENO)
+        close(f->fd);
+    free(f->buffer);
+    free(f);
+}
+
+int32_t __coo_file_eof(const coo_file *f) {
+    return f->eof;
+}
+
+/* next line without its \n (or \r\n) in *start, returns its length */
+int64_t __coo_file_line(coo_file *f, const char **start) {
+    coo_file_fill(f, 1);
+    if (f->pos >= f->size) {
+        f->eof = 1;
+        *start = f->data + f->pos;
+        return 0;
+    }
+    int64_t scanned = 0;
+    const char *newline;
+    for (;;) {
+        newline = memchr(f->data + f->pos + scanned, '\n', f->size - f->pos - scanned);
+        if (newline || f->mapped || f->drained)
+            break;
+        /* the line goes on past the buffer, read at least twice as much */
+        scanned = f->size - f->pos;
+        coo_file_fill(f, 2 * (f->size - f->pos) + 1);
+    }
+    const char *line = f->data + f->pos;
+    int64_t length = newline ? newline - line : f->size - f->pos;
+    f->pos += newline ? length + 1 : length;
+    if (length > 0 && line[length - 1] == '\r')
+        length--;
+    *start = line;
+    return length;
+}
+
+/* next n bytes in *start, fewer at the end */
+int64_t __coo_file_record(coo_file *f, int64_t n, const char **start) {
+    coo_file_fill(f, n);
+    int64_t length = f->size - f->pos < n ? f->size - f->pos : n;
+    if (length <= 0)
+        f->eof = 1;
+    *start = f->data + f->pos;
+    f->pos += length;
+    return length;
+}
+
+/* the number at the cursor after blanks, its characters are copied out so the parse never runs off the data */
+static int64_t coo_file_number(coo_file *f, char *number) {
+    for (;;) {
+        coo_file_fill(f, COO_NUMBER);
+        while (f->pos < f->size && (f->data[f->pos] == ' ' || f->data[f->pos] == '\t' ||
+                                    f->data[f->pos] == '\n' || f->data[f->pos] == '\r'))
+            f->pos++;
+        if (f->pos < f->size || f->mapped || f->drained)
+            break;
+    }
+    int64_t n = 0;
+    coo_file_fill(f, COO_NUMBER);
+    while (f->pos + n < f->size && n < COO_NUMBER - 1 && strchr(" \t\r\n", f->data[f->pos + n]) == NULL)
+        n++;
+    if (n == 0)
+        f->eof = 1;
+    memcpy(number, f->data + f->pos, n);
+    number[n] = '\0';
+    return n;
+}
+
+int64_t __coo_file_read_int(coo_file *f) {
+    char number[COO_NUMBER];
+    int64_t n = coo_file_number(f, number);
+    char *end = number;
+    int64_t value = strtoll(number, &end, 10);
+    f->pos += end - number > 0 ? end - number : n;
+    return value;
+}
+
+double __coo_file_read_float(coo_file *f) {
+    char number[COO_NUMBER];
+    int64_t n = coo_file_number(f, number);
+    char *end = number;
+    double value = strtod(number, &end);
+    f->pos += end - number > 0 ? end - number : n;
+    return value;
+}
+
+/* integer at the start of the n characters at p after blanks, 0 if there is none */
+int64_t __coo_parse_int(const char *p, int64_t n) {
+    int64_t i = 0;
+    while (i < n && (p[i] == ' ' || p[i] == '\t'))
+        i++;
+    int negative = i < n && p[i] == '-';
+    if (i < n && (p[i] == '-' || p[i] == '+'))
+        i++;
+    uint64_t value = 0;
+    for (; i < n && p[i] >= '0' && p[i] <= '9'; i++)
+        value = value * 10 + (uint64_t)(p[i] - '0');
+    return negative ? -(int64_t)value : (int64_t)value;
+}
+
+double __coo_parse_float(const char *p, int64_t n) {
+    char number[COO_NUMBER];
+    int64_t i = 0;
+    while (i < n && (p[i] == ' ' || p[i] == '\t'))
+        i++;
+    int64_t length = n - i < COO_NUMBER - 1 ? n - i : COO_NUMBER - 1;
+    memcpy(number, p + i, length);
+    number[length] = '\0';
+    return strtod(number, NULL);
+}
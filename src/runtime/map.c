@@ -0,0 +1,237 @@
+/**
+ * Hash table behind map[K]V, an open addressing table in the Swiss table
+ * layout: one control byte per slot, slots probed in groups of 16.
+ *
+ * A control byte is EMPTY, DELETED or, for a full slot, the low 7 bits of
+ * the key's hash (h2). A lookup compares h2 against a whole group at once
+ * (one SSE2 compare where available) and only touches the keys whose byte
+ * matches, so most probes never leave the control array. The remaining
+ * hash bits (h1) pick the first group, later groups follow a triangular
+ * sequence which visits every group of a power of two table.
+ *
+ * Keys and values are 64 bit slots filled by the compiler: integers widened,
+ * floats by their bits, strings as pointers. String keys are hashed and
+ * compared by content and the table keeps its own copy of them, a string
+ * of the runtime (string.c) like any other.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+char *__coo_str_copy(const char *p, int64_t n);
+void __coo_str_free(char *s);
+
+#define COO_GROUP 16
+#define COO_EMPTY ((uint8_t)0x80)
+#define COO_DELETED ((uint8_t)0xfe)
+
+typedef struct coo_map {
+    uint8_t *ctrl;
+    uint64_t *keys;
+    uint64_t *values;
+    int64_t capacity;     /* slots, zero or a power of two of at least COO_GROUP */
+    int64_t size;
+    int64_t growth_left;  /* EMPTY slots that may still be used before a rehash */
+    int string_keys;
+} coo_map;
+
+/* bit i set where ctrl[i] == byte */
+static inline uint32_t coo_group_match(const uint8_t *ctrl, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < COO_GROUP; i++)
+        mask |= (uint32_t)(ctrl[i] == byte) << i;
+    return mask;
+#endif
+}
+
+/* bit i set where slot i is EMPTY or DELETED, the only bytes with the top bit set */
+static inline uint32_t coo_group_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < COO_GROUP; i++)
+        mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+static inline uint64_t coo_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t coo_hash(const coo_map *m, uint64_t key) {
+    if (!m->string_keys)
+        return coo_mix(key);
+    /* FNV-1a, mixed so that h1 and h2 both depend on every byte */
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const unsigned char *s = (const unsigned char *)(uintptr_t)key; *s; s++)
+        h = (h ^ *s) * 0x100000001b3ull;
+    return coo_mix(h);
+}
+
+static inline int coo_key_equal(const coo_map *m, uint64_t stored, uint64_t key) {
+    if (!m->string_keys)
+        return stored == key;
+    return strcmp((const char *)(uintptr_t)stored, (const char *)(uintptr_t)key) == 0;
+}
+
+static uint64_t coo_key_copy(uint64_t key) {
+    const char *s = (const char *)(uintptr_t)key;
+    return (uint64_t)(uintptr_t)__coo_str_copy(s, strlen(s));
+}
+
+/* slot holding key, -1 if there is none */
+static int64_t coo_map_find(const coo_map *m, uint64_t key, uint64_t hash) {
+    if (m->capacity == 0)
+        return -1;
+    uint8_t h2 = hash & 0x7f;
+    int64_t mask = m->capacity / COO_GROUP - 1;
+    int64_t group = (hash >> 7) & mask;
+    for (int64_t step = 1;; step++) {
+        const uint8_t *ctrl = m->ctrl + group * COO_GROUP;
+        for (uint32_t hits = coo_group_match(ctrl, h2); hits; hits &= hits - 1) {
+            int64_t slot = group * COO_GROUP + __builtin_ctz(hits);
+            if (coo_key_equal(m, m->keys[slot], key))
+                return slot;
+        }
+        /* an EMPTY slot ends the probe, an insert would have used it */
+        if (coo_group_match(ctrl, COO_EMPTY))
+            return -1;
+        group = (group + step) & mask;
+    }
+}
+
+/* first EMPTY or DELETED slot on the probe sequence of hash */
+static int64_t coo_map_free_slot(const coo_map *m, uint64_t hash) {
+    int64_t mask = m->capacity / COO_GROUP - 1;
+    int64_t group = (hash >> 7) & mask;
+    for (int64_t step = 1;; step++) {
+        uint32_t free = coo_group_free(m->ctrl + group * COO_GROUP);
+        if (free)
+            return group * COO_GROUP + __builtin_ctz(free);
+        group = (group + step) & mask;
+    }
+}
+
+/* smallest table that holds n keys at a load of at most 7/8 */
+static int64_t coo_map_capacity(int64_t n) {
+    int64_t capacity = COO_GROUP;
+    while (capacity / 8 * 7 < n)
+        capacity *= 2;
+    return capacity;
+}
+
+/* move every key into a fresh table of capacity slots, dropping the DELETED ones */
+static void coo_map_rehash(coo_map *m, int64_t capacity) {
+    coo_map old = *m;
+    m->ctrl = malloc(capacity);
+    m->keys = malloc(capacity * sizeof(uint64_t));
+    m->values = malloc(capacity * sizeof(uint64_t));
+    memset(m->ctrl, COO_EMPTY, capacity);
+    m->capacity = capacity;
+    m->growth_left = capacity / 8 * 7 - old.size;
+    for (int64_t i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] & 0x80)
+            continue;
+        uint64_t hash = coo_hash(m, old.keys[i]);
+        int64_t slot = coo_map_free_slot(m, hash);
+        m->ctrl[slot] = hash & 0x7f;
+        m->keys[slot] = old.keys[i];
+        m->values[slot] = old.values[i];
+    }
+    free(old.ctrl);
+    free(old.keys);
+    free(old.values);
+}
+
+coo_map *__coo_map_new(int32_t string_keys) {
+    coo_map *m = calloc(1, sizeof(coo_map));
+    m->string_keys = string_keys;
+    return m;
+}
+
+int64_t __coo_map_len(const coo_map *m) {
+    return m->size;
+}
+
+/* make room for n keys without another rehash */
+void __coo_map_reserve(coo_map *m, int64_t n) {
+    int64_t capacity = coo_map_capacity(n);
+    if (capacity > m->capacity)
+        coo_map_rehash(m, capacity);
+}
+
+int32_t __coo_map_has(const coo_map *m, uint64_t key) {
+    return coo_map_find(m, key, coo_hash(m, key)) >= 0;
+}
+
+/* the value of key, 0 if it is not in the map */
+uint64_t __coo_map_get(const coo_map *m, uint64_t key) {
+    int64_t slot = coo_map_find(m, key, coo_hash(m, key));
+    return slot < 0 ? 0 : m->values[slot];
+}
+
+void __coo_map_put(coo_map *m, uint64_t key, uint64_t value) {
+    uint64_t hash = coo_hash(m, key);
+    int64_t slot = coo_map_find(m, key, hash);
+    if (slot >= 0) {
+        m->values[slot] = value;
+        return;
+    }
+    if (m->growth_left == 0)
+        coo_map_rehash(m, coo_map_capacity(2 * (m->size + 1)));
+    slot = coo_map_free_slot(m, hash);
+    if (m->ctrl[slot] == COO_EMPTY)
+        m->growth_left--;
+    m->ctrl[slot] = hash & 0x7f;
+    m->keys[slot] = m->string_keys ? coo_key_copy(key) : key;
+    m->values[slot] = value;
+    m->size++;
+}
+
+/* remove key, returns 0 if it was not in the map */
+int32_t __coo_map_delete(coo_map *m, uint64_t key) {
+    int64_t slot = coo_map_find(m, key, coo_hash(m, key));
+    if (slot < 0)
+        return 0;
+    if (m->string_keys)
+        __coo_str_free((char *)(uintptr_t)m->keys[slot]);
+    /* a group with an EMPTY slot never let a probe pass, so the slot can be EMPTY again */
+    if (coo_group_match(m->ctrl + slot / COO_GROUP * COO_GROUP, COO_EMPTY)) {
+        m->ctrl[slot] = COO_EMPTY;
+        m->growth_left++;
+    } else {
+        m->ctrl[slot] = COO_DELETED;
+    }
+    m->size--;
+    return 1;
+}
+
+/* iteration: the full slot after slot (-1 starts), -1 past the last one */
+int64_t __coo_map_next(const coo_map *m, int64_t slot) {
+    for (slot++; slot < m->capacity; slot++)
+        if (!(m->ctrl[slot] & 0x80))
+            return slot;
+    return -1;
+}
+
+uint64_t __coo_map_key(const coo_map *m, int64_t slot) {
+    return m->keys[slot];
+}
+
+uint64_t __coo_map_value(const coo_map *m, int64_t slot) {
+    return m->values[slot];
+}
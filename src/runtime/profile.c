@@ -0,0 +1,398 @@
+/**
+ * Function level profiler for programs compiled with `coo --instrument`.
+ *
+ * Generated code calls __coo_prof_enter/__coo_prof_exit around every function
+ * and for loop (a "region"). Each thread keeps its own counters, a shadow stack
+ * and a calling context tree, so the hot path never takes a lock. Cycles come
+ * from rdtsc where available. At exit two files are written:
+ *
+ *   <base>.txt     flat profile, call graph and the most recent samples
+ *   <base>.folded  folded stacks ("main;sort;anonymous cycles"), the input of
+ *                  flamegraph.pl and compatible tools
+ *
+ * <base> is $COO_PROFILE, or coo-profile.
+ *
+ * Spawned workers may still run instrumented code while the exit handler
+ * dumps. A hook marks its thread busy and leaves everything alone once the
+ * dump has started; the dump waits for busy threads, so it reads counters
+ * nobody writes to any more.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define COO_PROF_MAX_REGIONS 4096
+#define COO_PROF_MAX_DEPTH 1024
+#define COO_PROF_MAX_NODES 16384
+#define COO_PROF_SAMPLES 4096
+
+typedef struct {
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+} coo_prof_region;
+
+/* calling context tree node: one region reached through one call path */
+typedef struct {
+    int32_t region;
+    int32_t parent;
+    int32_t first_child;
+    int32_t next_sibling;
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+} coo_prof_node;
+
+typedef struct {
+    int32_t region;
+    int32_t node;
+    uint64_t start;
+    uint64_t children;
+} coo_prof_frame;
+
+typedef struct {
+    int32_t region;
+    uint64_t start;
+    uint64_t cycles;
+} coo_prof_sample;
+
+typedef struct coo_prof_thread {
+    struct coo_prof_thread *next;
+    atomic_int busy;
+    int index;
+    int depth;
+    uint64_t overflow;
+    int32_t node_count;
+    int32_t first_root;
+    uint64_t sample_count;
+    coo_prof_frame stack[COO_PROF_MAX_DEPTH];
+    coo_prof_region regions[COO_PROF_MAX_REGIONS];
+    coo_prof_node nodes[COO_PROF_MAX_NODES];
+    coo_prof_sample samples[COO_PROF_SAMPLES];
+} coo_prof_thread;
+
+/* set by whichever thread enters a region first, every thread stores the same name */
+static _Atomic(const char *) region_names[COO_PROF_MAX_REGIONS];
+static _Atomic(coo_prof_thread *) threads;
+static atomic_int thread_count;
+static atomic_flag registered = ATOMIC_FLAG_INIT;
+static atomic_int dumping;
+static uint64_t start_cycles, start_ns;
+static __thread coo_prof_thread *current;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+static void coo_prof_dump(void);
+
+static coo_prof_thread *coo_prof_thread_state(void) {
+    if (current) {
+        return current;
+    }
+
+    if (!atomic_flag_test_and_set(&registered)) {
+        start_cycles = now_cycles();
+        start_ns = now_ns();
+        atexit(coo_prof_dump);
+    }
+
+    coo_prof_thread *t = calloc(1, sizeof(coo_prof_thread));
+    if (!t) {
+        abort();
+    }
+    t->index = atomic_fetch_add(&thread_count, 1);
+    t->first_root = -1;
+    t->next = atomic_load(&threads);
+    while (!atomic_compare_exchange_weak(&threads, &t->next, t));
+    current = t;
+    return t;
+}
+
+/* false once the dump has started, otherwise t stays busy until coo_prof_leave */
+static inline int coo_prof_claim(coo_prof_thread *t) {
+    atomic_store(&t->busy, 1);
+    if (atomic_load(&dumping)) {
+        atomic_store_explicit(&t->busy, 0, memory_order_release);
+        return 0;
+    }
+    return 1;
+}
+
+static inline void coo_prof_leave(coo_prof_thread *t) {
+    atomic_store_explicit(&t->busy, 0, memory_order_release);
+}
+
+/* child of parent for region, a -1 parent is the root */
+static int32_t coo_prof_child(coo_prof_thread *t, int32_t parent, int32_t region) {
+    int32_t *first = parent >= 0 ? &t->nodes[parent].first_child : &t->first_root;
+    for (int32_t child = *first; child >= 0; child = t->nodes[child].next_sibling) {
+        if (t->nodes[child].region == region) {
+            return child;
+        }
+    }
+
+    if (t->node_count == COO_PROF_MAX_NODES) {
+        return -1;
+    }
+    int32_t node = t->node_count++;
+    t->nodes[node].region = region;
+    t->nodes[node].parent = parent;
+    t->nodes[node].first_child = -1;
+    t->nodes[node].next_sibling = *first;
+    *first = node;
+    return node;
+}
+
+void __coo_prof_enter(int32_t region, const char *name) {
+    coo_prof_thread *t = coo_prof_thread_state();
+    if (region < 0 || region >= COO_PROF_MAX_REGIONS || !coo_prof_claim(t)) {
+        return;
+    }
+    if (!atomic_load_explicit(&region_names[region], memory_order_relaxed)) {
+        atomic_store_explicit(&region_names[region], name, memory_order_relaxed);
+    }
+
+    if (t->depth == COO_PROF_MAX_DEPTH || t->overflow) {
+        t->overflow++;
+        coo_prof_leave(t);
+        return;
+    }
+
+    // no node once the tree is full, the flat profile still counts the frame
+    int32_t node = -1;
+    if (t->depth == 0) {
+        node = coo_prof_child(t, -1, region);
+    } else if (t->stack[t->depth - 1].node >= 0) {
+        node = coo_prof_child(t, t->stack[t->depth - 1].node, region);
+    }
+
+    coo_prof_frame *frame = &t->stack[t->depth++];
+    frame->region = region;
+    frame->node = node;
+    frame->children = 0;
+    frame->start = now_cycles();
+    coo_prof_leave(t);
+}
+
+/**
+ * Leave region. Frames above it are closed as well, they belong to loops
+ * left early through `ret`.
+ */
+void __coo_prof_exit(int32_t region) {
+    uint64_t now = now_cycles();
+    coo_prof_thread *t = current;
+    if (!t || region < 0 || region >= COO_PROF_MAX_REGIONS || !coo_prof_claim(t)) {
+        return;
+    }
+    if (t->overflow) {
+        t->overflow--;
+        coo_prof_leave(t);
+        return;
+    }
+
+    int open = t->depth - 1;
+    while (open >= 0 && t->stack[open].region != region) {
+        open--;
+    }
+    if (open < 0) {
+        coo_prof_leave(t);
+        return;
+    }
+
+    while (t->depth > open) {
+        coo_prof_frame *frame = &t->stack[--t->depth];
+        uint64_t total = now - frame->start;
+        uint64_t self = total > frame->children ? total - frame->children : 0;
+
+        coo_prof_region *stats = &t->regions[frame->region];
+        stats->calls++;
+        stats->self += self;
+        stats->total += total;
+        if (frame->node >= 0) {
+            t->nodes[frame->node].calls++;
+            t->nodes[frame->node].self += self;
+            t->nodes[frame->node].total += total;
+        }
+        if (t->depth > 0) {
+            t->stack[t->depth - 1].children += total;
+        }
+
+        coo_prof_sample *sample = &t->samples[t->sample_count++ % COO_PROF_SAMPLES];
+        sample->region = frame->region;
+        sample->start = frame->start - start_cycles;
+        sample->cycles = total;
+    }
+    coo_prof_leave(t);
+}
+
+static const char *coo_prof_name(int32_t region) {
+    const char *name = atomic_load_explicit(&region_names[region], memory_order_relaxed);
+    return name ? name : "?";
+}
+
+typedef struct {
+    int32_t caller;
+    int32_t callee;
+    uint64_t calls;
+    uint64_t cycles;
+} coo_prof_edge;
+
+static int coo_prof_edge_cmp(const void *a, const void *b) {
+    const coo_prof_edge *x = a, *y = b;
+    if (x->caller != y->caller) return x->caller < y->caller ? -1 : 1;
+    if (x->callee != y->callee) return x->callee < y->callee ? -1 : 1;
+    return 0;
+}
+
+static coo_prof_region merged[COO_PROF_MAX_REGIONS];
+
+static int coo_prof_self_cmp(const void *a, const void *b) {
+    uint64_t x = merged[*(const int32_t *)a].self, y = merged[*(const int32_t *)b].self;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void coo_prof_dump(void) {
+    // hooks that started before the flag finish, later ones see it and return
+    atomic_store(&dumping, 1);
+    for (coo_prof_thread *t = atomic_load(&threads); t; t = t->next) {
+        while (atomic_load_explicit(&t->busy, memory_order_acquire)) {
+            sched_yield();
+        }
+    }
+
+    const char *base = getenv("COO_PROFILE");
+    char path[4096];
+    if (!base || !*base) {
+        base = "coo-profile";
+    }
+
+    double cycles_per_ms = 1e6;
+    uint64_t elapsed_ns = now_ns() - start_ns;
+    if (elapsed_ns > 0) {
+        cycles_per_ms = (double)(now_cycles() - start_cycles) * 1e6 / elapsed_ns;
+    }
+
+    // flat profile over all threads
+    static int32_t order[COO_PROF_MAX_REGIONS];
+    uint64_t all_self = 0;
+    size_t edge_count = 0;
+    for (coo_prof_thread *t = atomic_load(&threads); t; t = t->next) {
+        for (int i = 0; i < COO_PROF_MAX_REGIONS; i++) {
+            merged[i].calls += t->regions[i].calls;
+            merged[i].self += t->regions[i].self;
+            merged[i].total += t->regions[i].total;
+            all_self += t->regions[i].self;
+        }
+        edge_count += t->node_count;
+    }
+
+    snprintf(path, sizeof(path), "%s.txt", base);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return;
+    }
+
+    int used = 0;
+    for (int i = 0; i < COO_PROF_MAX_REGIONS; i++) {
+        if (merged[i].calls) order[used++] = i;
+    }
+    qsort(order, used, sizeof(int32_t), coo_prof_self_cmp);
+
+    fprintf(out, "Flat profile (%d threads, %.0f cycles/ms):\n\n", atomic_load(&thread_count), cycles_per_ms);
+    fprintf(out, "%7s %16s %12s %12s %12s  %s\n", "self%", "self cycles", "self ms", "total ms", "calls", "name");
+    for (int i = 0; i < used; i++) {
+        coo_prof_region *r = &merged[order[i]];
+        fprintf(out, "%6.2f%% %16llu %12.3f %12.3f %12llu  %s\n",
+            all_self ? 100.0 * r->self / all_self : 0.0, (unsigned long long)r->self,
+            r->self / cycles_per_ms, r->total / cycles_per_ms, (unsigned long long)r->calls,
+            coo_prof_name(order[i]));
+    }
+
+    // call graph: caller -> callee edges merged over call paths and threads
+    coo_prof_edge *edges = calloc(edge_count ? edge_count : 1, sizeof(coo_prof_edge));
+    size_t n = 0;
+    for (coo_prof_thread *t = atomic_load(&threads); t && edges; t = t->next) {
+        for (int32_t i = 0; i < t->node_count; i++) {
+            coo_prof_node *node = &t->nodes[i];
+            edges[n].caller = node->parent >= 0 ? t->nodes[node->parent].region : -1;
+            edges[n].callee = node->region;
+            edges[n].calls = node->calls;
+            edges[n].cycles = node->total;
+            n++;
+        }
+    }
+    if (edges) {
+        qsort(edges, n, sizeof(coo_prof_edge), coo_prof_edge_cmp);
+    }
+
+    fprintf(out, "\nCall graph:\n\n");
+    fprintf(out, "%12s %12s  %s\n", "calls", "total ms", "caller -> callee");
+    for (size_t i = 0; i < n; i++) {
+        coo_prof_edge edge = edges[i];
+        while (i + 1 < n && edges[i + 1].caller == edge.caller && edges[i + 1].callee == edge.callee) {
+            i++;
+            edge.calls += edges[i].calls;
+            edge.cycles += edges[i].cycles;
+        }
+        fprintf(out, "%12llu %12.3f  %s -> %s\n", (unsigned long long)edge.calls, edge.cycles / cycles_per_ms,
+            edge.caller >= 0 ? coo_prof_name(edge.caller) : "<root>", coo_prof_name(edge.callee));
+    }
+    free(edges);
+
+    fprintf(out, "\nRecent samples (thread, start cycle, cycles, name):\n\n");
+    for (coo_prof_thread *t = atomic_load(&threads); t; t = t->next) {
+        uint64_t first = t->sample_count > COO_PROF_SAMPLES ? t->sample_count - COO_PROF_SAMPLES : 0;
+        for (uint64_t i = first; i < t->sample_count; i++) {
+            coo_prof_sample *sample = &t->samples[i % COO_PROF_SAMPLES];
+            fprintf(out, "%d %llu %llu %s\n", t->index, (unsigned long long)sample->start,
+                (unsigned long long)sample->cycles, coo_prof_name(sample->region));
+        }
+    }
+    fclose(out);
+
+    // folded stacks, self cycles of every call path
+    snprintf(path, sizeof(path), "%s.folded", base);
+    out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return;
+    }
+    for (coo_prof_thread *t = atomic_load(&threads); t; t = t->next) {
+        for (int32_t i = 0; i < t->node_count; i++) {
+            if (!t->nodes[i].self) {
+                continue;
+            }
+            int32_t chain[COO_PROF_MAX_DEPTH];
+            int depth = 0;
+            for (int32_t node = i; node >= 0 && depth < COO_PROF_MAX_DEPTH; node = t->nodes[node].parent) {
+                chain[depth++] = t->nodes[node].region;
+            }
+            while (depth--) {
+                fprintf(out, "%s%c", coo_prof_name(chain[depth]), depth ? ';' : ' ');
+            }
+            fprintf(out, "%llu\n", (unsigned long long)t->nodes[i].self);
+        }
+    }
+    fclose(out);
+
+    fprintf(stderr, "coo profile wrote to %s.txt and %s.folded\n", base, base);
+}
@@ -0,0 +1,113 @@
+/**
+ * Strings stay NUL terminated char pointers for C, with a header right in
+ * front of the characters that keeps their length and capacity, so len(s)
+ * is one load instead of a strlen. The compiler emits literals with the
+ * same header and a capacity of 0, they are never written.
+ *
+ * Concatenation allocates the result once. A concatenation that is the
+ * left side of another + is appended to in place, and appends double the
+ * capacity when they run out, so a + b + c + d costs one buffer that grows
+ * a few times rather than a copy per +. strbuf appends the same way into a
+ * buffer it owns. Views (the compiler's strview, a pointer and a length)
+ * point into a string and copy nothing until string(v).
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct coo_str {
+    int64_t cap;    /* characters that fit without growing, 0 for literals */
+    int64_t len;
+    char data[];
+} coo_str;
+
+typedef struct coo_strbuf {
+    char *data;
+} coo_strbuf;
+
+#define COO_STR_HEADER(s) ((coo_str *)((char *)(s) - offsetof(coo_str, data)))
+
+static coo_str *coo_str_alloc(int64_t cap) {
+    coo_str *s = malloc(sizeof(coo_str) + cap + 1);
+    s->cap = cap;
+    s->len = 0;
+    s->data[0] = '\0';
+    return s;
+}
+
+/* a new string holding the n characters at p */
+char *__coo_str_copy(const char *p, int64_t n) {
+    coo_str *s = coo_str_alloc(n);
+    memcpy(s->data, p, n);
+    s->data[n] = '\0';
+    s->len = n;
+    return s->data;
+}
+
+/* only for strings the runtime allocated */
+void __coo_str_free(char *s) {
+    free(COO_STR_HEADER(s));
+}
+
+char *__coo_str_concat(const char *a, int64_t a_len, const char *b, int64_t b_len) {
+    coo_str *s = coo_str_alloc(a_len + b_len);
+    memcpy(s->data, a, a_len);
+    memcpy(s->data + a_len, b, b_len);
+    s->len = a_len + b_len;
+    s->data[s->len] = '\0';
+    return s->data;
+}
+
+/* append to a runtime string that nothing else refers to, it may move */
+char *__coo_str_append(char *a, const char *b, int64_t b_len) {
+    coo_str *s = COO_STR_HEADER(a);
+    if (s->len + b_len > s->cap) {
+        int64_t cap = 2 * s->cap > s->len + b_len ? 2 * s->cap : s->len + b_len;
+        s = realloc(s, sizeof(coo_str) + cap + 1);
+        s->cap = cap;
+    }
+    memcpy(s->data + s->len, b, b_len);
+    s->len += b_len;
+    s->data[s->len] = '\0';
+    return s->data;
+}
+
+coo_strbuf *__coo_strbuf_new(void) {
+    coo_strbuf *b = malloc(sizeof(coo_strbuf));
+    b->data = coo_str_alloc(16)->data;
+    return b;
+}
+
+void __coo_strbuf_append(coo_strbuf *b, const char *p, int64_t n) {
+    b->data = __coo_str_append(b->data, p, n);
+}
+
+void __coo_strbuf_append_int(coo_strbuf *b, int64_t value, int32_t is_unsigned) {
+    char digits[24];
+    char *end = digits + sizeof(digits), *p = end;
+    uint64_t magnitude = is_unsigned || value >= 0 ? (uint64_t)value : -(uint64_t)value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (!is_unsigned && value < 0)
+        *--p = '-';
+    __coo_strbuf_append(b, p, end - p);
+}
+
+void __coo_strbuf_append_float(coo_strbuf *b, double value) {
+    char digits[32];
+    int n = snprintf(digits, sizeof(digits), "%g", value);
+    __coo_strbuf_append(b, digits, n);
+}
+
+int64_t __coo_strbuf_len(const coo_strbuf *b) {
+    return COO_STR_HEADER(b->data)->len;
+}
+
+/* the contents as a string of their own, the builder keeps appending to its buffer */
+char *__coo_strbuf_string(const coo_strbuf *b) {
+    return __coo_str_copy(b->data, COO_STR_HEADER(b->data)->len);
+}
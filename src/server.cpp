@@ -0,0 +1,243 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <llvm/Support/Host.h>
+
+#include "codegen.h"
+#include "objgen.h"
+#include "driver.h"
+#include "server.h"
+
+/**
+ * Compile server protocol over a local unix socket.
+ *
+ * request:  NUL terminated strings: the decimal count of the fields that
+ *           follow, then the client working directory and the compile
+ *           arguments. The count lets a field be empty.
+ * response: the compiler output as it is produced, then a single NUL byte
+ *           followed by the decimal exit status.
+ */
+
+std::string defaultSocketPath() {
+	const char *path = getenv("COO_SERVER_SOCKET");
+	if (path && *path) {
+		return path;
+	}
+	return "/tmp/coo-server-" + std::to_string(getuid()) + ".sock";
+}
+
+static bool writeAll(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool fillAddress(const std::string& socketPath, sockaddr_un& addr) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "socket path too long: " << socketPath << std::endl;
+		return false;
+	}
+	strcpy(addr.sun_path, socketPath.c_str());
+	return true;
+}
+
+/* Read the field count, then that many NUL terminated strings */
+static bool readRequest(int conn, std::vector<std::string>& fields) {
+	std::string field;
+	bool counted = false;
+	size_t count = 0;
+	char buf[4096];
+	for (;;) {
+		ssize_t n = read(conn, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] != '\0') {
+				field.push_back(buf[i]);
+				continue;
+			}
+			if (counted) {
+				fields.push_back(field);
+			} else {
+				char *end;
+				count = strtoul(field.c_str(), &end, 10);
+				if (field.empty() || *end != '\0') {
+					return false;
+				}
+				counted = true;
+			}
+			field.clear();
+			if (fields.size() == count) {
+				return true;
+			}
+		}
+	}
+}
+
+/* Compile one request in a forked child whose stdout/stderr is the socket */
+static int serveRequest(int conn) {
+	std::vector<std::string> fields;
+	if (!readRequest(conn, fields) || fields.empty()) {
+		return 1;
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		dup2(conn, STDOUT_FILENO);
+		dup2(conn, STDERR_FILENO);
+		close(conn);
+
+		CompileOptions options;
+		std::vector<std::string> args(fields.begin() + 1, fields.end());
+		if (chdir(fields[0].c_str()) != 0) {
+			std::cerr << "cannot enter directory " << fields[0] << std::endl;
+			exit(1);
+		}
+		if (!parseOptions(args, options)) {
+			usage();
+			exit(1);
+		}
+		exit(compile(options));
+	}
+
+	int status = 1;
+	if (pid > 0) {
+		int wstatus;
+		while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR);
+		if (WIFEXITED(wstatus)) {
+			status = WEXITSTATUS(wstatus);
+		} else if (WIFSIGNALED(wstatus)) {
+			status = 128 + WTERMSIG(wstatus);
+		}
+	}
+
+	std::string trailer = std::string(1, '\0') + std::to_string(status);
+	writeAll(conn, trailer.data(), trailer.size());
+	close(conn);
+	return status;
+}
+
+int runServer(const std::string& socketPath) {
+	// pay LLVM start-up once, every request is forked from this warm process
+	InitializeObjGen();
+	GetTargetMachine(llvm::sys::getDefaultTargetTriple());
+
+	sockaddr_un addr;
+	if (!fillAddress(socketPath, addr)) {
+		return 1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	unlink(socketPath.c_str());
+	if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+		perror(socketPath.c_str());
+		close(fd);
+		return 1;
+	}
+
+	// connection handlers are never waited for
+	signal(SIGCHLD, SIG_IGN);
+	std::cout << "coo server listening on " << socketPath << std::endl;
+
+	for (;;) {
+		int conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			break;
+		}
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fd);
+			signal(SIGCHLD, SIG_DFL);
+			_exit(serveRequest(conn));
+		}
+		if (pid < 0) {
+			perror("fork");
+		}
+		close(conn);
+	}
+
+	close(fd);
+	unlink(socketPath.c_str());
+	return 1;
+}
+
+int runClient(const std::string& socketPath, const std::vector<std::string>& args) {
+	sockaddr_un addr;
+	if (!fillAddress(socketPath, addr)) {
+		return 1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+		std::cerr << "cannot connect to coo server at " << socketPath
+			<< ", start one with ./coo --server" << std::endl;
+		return 1;
+	}
+
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("getcwd");
+		return 1;
+	}
+
+	std::string request = std::to_string(args.size() + 1) + '\0' + cwd + '\0';
+	for (auto& arg : args) {
+		request += arg + '\0';
+	}
+	if (!writeAll(fd, request.data(), request.size())) {
+		perror("write");
+		return 1;
+	}
+
+	// stream output until the NUL byte which introduces the exit status
+	std::string status;
+	bool trailer = false;
+	char buf[4096];
+	for (;;) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		for (ssize_t i = 0; i < n; i++) {
+			if (trailer) {
+				status.push_back(buf[i]);
+			} else if (buf[i] == '\0') {
+				trailer = true;
+			} else {
+				std::cout.put(buf[i]);
+			}
+		}
+		std::cout.flush();
+	}
+	close(fd);
+
+	if (!trailer || status.empty()) {
+		std::cerr << "coo server closed the connection" << std::endl;
+		return 1;
+	}
+	return atoi(status.c_str());
+}